@@ -0,0 +1,65 @@
+#include "CPUFeatures.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace SR
+{
+    static void QueryCPUID(uint32 leaf, uint32 subleaf, uint32 registers[4])
+    {
+#if defined(_MSC_VER)
+        __cpuidex((int*)registers, (int)leaf, (int)subleaf);
+#else
+        __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+    }
+
+    static uint64 QueryXCR0()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32 eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return ((uint64)edx << 32) | eax;
+#endif
+    }
+
+    static CPUFeatures QueryCPUFeatures()
+    {
+        CPUFeatures features = {};
+
+        uint32 registers[4];
+        QueryCPUID(0, 0, registers);
+        const uint32 maxLeaf = registers[0];
+        if (maxLeaf < 1)
+        {
+            return features;
+        }
+
+        QueryCPUID(1, 0, registers);
+        features.sse2 = (registers[3] & (1u << 26)) != 0;
+        const bool osxsave = (registers[2] & (1u << 27)) != 0;
+        const bool avx = (registers[2] & (1u << 28)) != 0;
+        const bool fma = (registers[2] & (1u << 12)) != 0;
+
+        // AVX state must also be enabled by the OS (XMM and YMM bits of XCR0)
+        const bool osSupportsAVX = osxsave && avx && ((QueryXCR0() & 0x6) == 0x6);
+        if (osSupportsAVX && maxLeaf >= 7)
+        {
+            QueryCPUID(7, 0, registers);
+            features.avx2 = (registers[1] & (1u << 5)) != 0;
+            features.fma = fma;
+        }
+        return features;
+    }
+
+    const CPUFeatures& GetCPUFeatures()
+    {
+        static const CPUFeatures features = QueryCPUFeatures();
+        return features;
+    }
+}
\ No newline at end of file
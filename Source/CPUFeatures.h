@@ -0,0 +1,16 @@
+#pragma once
+
+#include "SRCommon.h"
+
+namespace SR
+{
+    struct CPUFeatures
+    {
+        bool sse2;
+        bool avx2;
+        bool fma;
+    };
+
+    // Instruction set extensions usable on this machine, queried once with CPUID.
+    extern const CPUFeatures& GetCPUFeatures();
+}
\ No newline at end of file
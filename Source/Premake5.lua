@@ -39,6 +39,10 @@ project "SoftwareRasterizer"
         thirdpartypath("stb/include"), 
     }
 
+    -- SIMD kernels selected at runtime with CPUID
+    filter "files:**AVX2.cpp"
+        buildoptions { "/arch:AVX2" }
+
     filter "system:windows"
         systemversion "latest"
 
@@ -1,4 +1,5 @@
 #include "Rasterizer.h"
+#include "RasterizerKernels.h"
 #include "Shader.h"
 #include "JobSystem.h"
 
@@ -48,18 +49,16 @@ namespace SR
         float alpha;
         float beta;
         float gamma;
-        bool IsInsideTriangle() const
-        {
-            return alpha >= 0.0f && beta >= 0.0f && gamma >= 0.0f;
-        }
     };
-    
-    static BarycentricCoordinates CalculateBarycentric2D(float x, float y, const Vector2& v0, const Vector2& v1, const Vector2& v2)
+
+    FORCEINLINE static bool DepthTest(CompareOp compareOp, float depth, float depthBufferValue)
     {
-        float alpha = (x * (v1.y - v2.y) + (v2.x - v1.x) * y + v1.x * v2.y - v2.x * v1.y) / (v0.x * (v1.y - v2.y) + (v2.x - v1.x) * v0.y + v1.x * v2.y - v2.x * v1.y);
-        float beta  = (x * (v2.y - v0.y) + (v0.x - v2.x) * y + v2.x * v0.y - v0.x * v2.y) / (v1.x * (v2.y - v0.y) + (v0.x - v2.x) * v1.y + v2.x * v0.y - v0.x * v2.y);
-        float gamma = (x * (v0.y - v1.y) + (v1.x - v0.x) * y + v0.x * v1.y - v1.x * v0.y) / (v2.x * (v0.y - v1.y) + (v1.x - v0.x) * v2.y + v0.x * v1.y - v1.x * v0.y);
-        return { alpha, beta, gamma };
+        switch (compareOp)
+        {
+        case COMPARE_OP_LESS_OR_EQUAL: return depth <= depthBufferValue;
+        case COMPARE_OP_GREATER:       return depth > depthBufferValue;
+        default:                       return true;
+        }
     }
 
     static float BarycentricLerp(float a, float b, float c, const BarycentricCoordinates& bary, float weight)
@@ -67,254 +66,1282 @@ namespace SR
         return (bary.alpha * a + bary.beta * b + bary.gamma * c) * weight;
     }
 
-    static Vector2 BarycentricLerp(const Vector2& a, const Vector2& b, const Vector2& c, const BarycentricCoordinates& bary, float weight)
+    void PerspectiveDivision(ShaderPayload* payload)
     {
-        return (bary.alpha * a + bary.beta * b + bary.gamma * c) * weight;
+        const float invW = 1.0f / payload->clipPosition.w;
+        payload->invW = invW;
+        payload->ndcPosition = Vector3(payload->clipPosition) * invW;
     }
 
-    static Vector3 BarycentricLerp(const Vector3& a, const Vector3& b, const Vector3& c, const BarycentricCoordinates& bary, float weight)
+    // Every attribute of ShaderPayload, for pixel shaders without a varying layout
+    static const VaryingLayout defaultVaryingLayout = {
+        5,
+        {
+            SHADER_VARYING(clipPosition, VARYING_INTERPOLATION_NOPERSPECTIVE, false),
+            SHADER_VARYING(worldPosition, VARYING_INTERPOLATION_PERSPECTIVE, false),
+            SHADER_VARYING(worldNormal, VARYING_INTERPOLATION_PERSPECTIVE, false),
+            SHADER_VARYING(worldTangent, VARYING_INTERPOLATION_PERSPECTIVE, false),
+            SHADER_VARYING(texCoord, VARYING_INTERPOLATION_PERSPECTIVE, false),
+        }
+    };
+
+    static const VaryingLayout emptyVaryingLayout = { 0, {} };
+
+    static VaryingPacking CreateVaryingPacking(const VaryingLayout& layout)
     {
-        return (bary.alpha * a + bary.beta * b + bary.gamma * c) * weight;
+        VaryingPacking packing;
+        packing.numComponents = 0;
+        packing.stride = 0;
+        for (uint32 i = 0; i < layout.numVaryings; i++)
+        {
+            const Varying& varying = layout.varyings[i];
+            for (uint32 c = 0; c < varying.numComponents; c++)
+            {
+                ASSERT(packing.numComponents < SHADER_MAX_VARYING_COMPONENTS);
+                VaryingComponent& component = packing.components[packing.numComponents++];
+                component.payloadOffset = varying.offset + c * (uint32)sizeof(float);
+                component.packedOffset = packing.stride;
+                component.interpolation = varying.interpolation;
+                component.halfPrecision = varying.halfPrecision;
+                packing.stride += varying.halfPrecision ? (uint32)sizeof(uint16) : (uint32)sizeof(float);
+            }
+        }
+        // Keep packed vertices 4-byte aligned
+        packing.stride = (packing.stride + 3) & ~3u;
+        return packing;
     }
 
-    static Vector4 BarycentricLerp(const Vector4& a, const Vector4& b, const Vector4& c, const BarycentricCoordinates& bary, float weight)
+    FORCEINLINE static float LoadVarying(const VaryingComponent& component, const uint8* varyings)
     {
-        return (bary.alpha * a + bary.beta * b + bary.gamma * c) * weight;
+        if (component.halfPrecision)
+        {
+            return glm::unpackHalf1x16(*(const uint16*)(varyings + component.packedOffset));
+        }
+        return *(const float*)(varyings + component.packedOffset);
     }
 
-    void PerspectiveDivision(ShaderPayload* payload)
+    FORCEINLINE static void StoreVarying(const VaryingComponent& component, float value, uint8* varyings)
     {
-        const float invW = 1.0f / payload->clipPosition.w;
-        payload->invW = invW;
-        payload->ndcPosition = Vector3(payload->clipPosition) * invW;
-        // Perspective correction: the world space properties should be multipy by 1/w before rasterization
-        payload->worldPosition *= invW;
-        payload->worldNormal *= invW;
-        payload->worldTangent *= invW;
-        payload->texCoord *= invW;
+        if (component.halfPrecision)
+        {
+            *(uint16*)(varyings + component.packedOffset) = glm::packHalf1x16(value);
+        }
+        else
+        {
+            *(float*)(varyings + component.packedOffset) = value;
+        }
+    }
+
+    static void PackVaryings(const VaryingPacking& packing, const ShaderPayload& payload, uint8* outVaryings)
+    {
+        for (uint32 c = 0; c < packing.numComponents; c++)
+        {
+            const VaryingComponent& component = packing.components[c];
+            float value = *(const float*)((const uint8*)&payload + component.payloadOffset);
+            if (component.interpolation == VARYING_INTERPOLATION_PERSPECTIVE)
+            {
+                // Perspective correction: divided by w here, multiplied by the interpolated w per pixel
+                value *= payload.invW;
+            }
+            StoreVarying(component, value, outVaryings);
+        }
+    }
+
+    // Writes interpolated packed values to the pixel shader input, w is the perspective-correct w of the pixel
+    static void UnpackVaryings(const VaryingPacking& packing, const float values[SHADER_MAX_VARYING_COMPONENTS], float w, ShaderPayload& outPayload)
+    {
+        for (uint32 c = 0; c < packing.numComponents; c++)
+        {
+            const VaryingComponent& component = packing.components[c];
+            const float value = component.interpolation == VARYING_INTERPOLATION_PERSPECTIVE ? values[c] * w : values[c];
+            *(float*)((uint8*)&outPayload + component.payloadOffset) = value;
+        }
+        outPayload.invW = 1.0f / w;
     }
 
     struct VertexShaderJobData
     {
         VertexShader shader;
-        uint32 vertexID;
-        ShaderPayload* payload;
+        uint32 firstVertexID;
+        uint32 numVertices;
+        const VaryingPacking* varyingPacking;
+        Vector4* clipPositions;
+        uint8* varyings;
         const void* pushConstants;
     };
 
     static void LaunchVertexShaderExecution(VertexShaderJobData* data)
     {
-        data->shader.Main(data->vertexID, *data->payload, data->pushConstants);
-        // Perspective division
-        PerspectiveDivision(data->payload);
+        // Shaded in chunks so the full payloads never need more than a fixed buffer on the stack
+        ShaderPayload payloads[RASTERIZER_VERTEX_SHADER_CHUNK_SIZE];
+        const VaryingPacking& packing = *data->varyingPacking;
+        for (uint32 first = 0; first < data->numVertices; first += RASTERIZER_VERTEX_SHADER_CHUNK_SIZE)
+        {
+            const uint32 numVertices = std::min((uint32)RASTERIZER_VERTEX_SHADER_CHUNK_SIZE, data->numVertices - first);
+            if (data->shader.MainBatch)
+            {
+                data->shader.MainBatch(data->firstVertexID + first, numVertices, payloads, data->pushConstants);
+            }
+            else
+            {
+                for (uint32 i = 0; i < numVertices; i++)
+                {
+                    data->shader.Main(data->firstVertexID + first + i, payloads[i], data->pushConstants);
+                    // Perspective division
+                    PerspectiveDivision(&payloads[i]);
+                }
+            }
+
+            // Only the position and the pixel shader's varyings outlive the job
+            for (uint32 i = 0; i < numVertices; i++)
+            {
+                data->clipPositions[first + i] = payloads[i].clipPosition;
+                PackVaryings(packing, payloads[i], data->varyings + (first + i) * packing.stride);
+            }
+        }
+    }
+
+    // Interpolation of a single pixel without triangle setup, used when resolving a visibility buffer
+    static void InterpolateVaryings(const VaryingPacking& packing, const uint8* const varyings[3], const BarycentricCoordinates& barycentric, float w, ShaderPayload& outPayload)
+    {
+        float values[SHADER_MAX_VARYING_COMPONENTS];
+        for (uint32 c = 0; c < packing.numComponents; c++)
+        {
+            const VaryingComponent& component = packing.components[c];
+            if (component.interpolation == VARYING_INTERPOLATION_FLAT)
+            {
+                values[c] = LoadVarying(component, varyings[0]);
+            }
+            else
+            {
+                values[c] = BarycentricLerp(LoadVarying(component, varyings[0]), LoadVarying(component, varyings[1]), LoadVarying(component, varyings[2]), barycentric, 1.0f);
+            }
+        }
+        UnpackVaryings(packing, values, w, outPayload);
+    }
+
+    // Pipeline state that changes the per-pixel work. Each combination is compiled into its own
+    // raster kernel, so the inner loops test none of these at run time.
+    enum RasterizationStateBits
+    {
+        RASTERIZATION_STATE_DEPTH_TEST       = 1 << 0,
+        // Set for COMPARE_OP_GREATER, clear for COMPARE_OP_LESS_OR_EQUAL
+        RASTERIZATION_STATE_DEPTH_GREATER    = 1 << 1,
+        RASTERIZATION_STATE_DEPTH_WRITE      = 1 << 2,
+        // Depth test before the pixel shader instead of after it
+        RASTERIZATION_STATE_EARLY_DEPTH_TEST = 1 << 3,
+        RASTERIZATION_STATE_HIZ              = 1 << 4,
+        // Two bits holding a RasterizationOutput
+        RASTERIZATION_STATE_OUTPUT_SHIFT     = 5,
+        RASTERIZATION_STATE_COUNT            = 1 << 7,
+    };
+
+    enum RasterizationOutput
+    {
+        RASTERIZATION_OUTPUT_NONE              = 0,
+        RASTERIZATION_OUTPUT_COLOR             = 1,
+        // No pixel shader, only depth is tested and written
+        RASTERIZATION_OUTPUT_DEPTH_ONLY        = 2,
+        RASTERIZATION_OUTPUT_VISIBILITY_BUFFER = 3,
+    };
 
+    template <uint32 StateBits>
+    struct RasterizationState
+    {
+        static constexpr bool depthTest = (StateBits & RASTERIZATION_STATE_DEPTH_TEST) != 0;
+        static constexpr CompareOp depthCompareOp = (StateBits & RASTERIZATION_STATE_DEPTH_GREATER) ? COMPARE_OP_GREATER : COMPARE_OP_LESS_OR_EQUAL;
+        static constexpr bool depthWrite = (StateBits & RASTERIZATION_STATE_DEPTH_WRITE) != 0;
+        static constexpr bool earlyDepthTest = depthTest && (StateBits & RASTERIZATION_STATE_EARLY_DEPTH_TEST) != 0;
+        static constexpr bool lateDepthTest = depthTest && !earlyDepthTest;
+        // Blocks are tested against Hi-Z with the depth test, and their bounds are updated on every depth write
+        static constexpr bool hizTest = depthTest && (StateBits & RASTERIZATION_STATE_HIZ) != 0;
+        static constexpr bool hizUpdate = depthWrite && (StateBits & RASTERIZATION_STATE_HIZ) != 0;
+        static constexpr bool hiz = hizTest || hizUpdate;
+        static constexpr RasterizationOutput output = (RasterizationOutput)(StateBits >> RASTERIZATION_STATE_OUTPUT_SHIFT);
+        // The pixel shader runs in the rasterizer, so w and the varyings are needed per pixel
+        static constexpr bool shadePixels = output != RASTERIZATION_OUTPUT_DEPTH_ONLY && output != RASTERIZATION_OUTPUT_VISIBILITY_BUFFER;
+    };
+
+    static uint32 GetRasterizationStateBits(const GraphicsPipelineState& pipelineState)
+    {
+        uint32 stateBits = 0;
+        if (pipelineState.depthTestEnable)
+        {
+            stateBits |= RASTERIZATION_STATE_DEPTH_TEST;
+            stateBits |= pipelineState.depthCompareOp == COMPARE_OP_GREATER ? RASTERIZATION_STATE_DEPTH_GREATER : 0;
+            // Without a pixel shader in the geometry pass or a depth-only pass nothing can discard or modify depth
+            stateBits |= pipelineState.earlyDepthTestEnable || pipelineState.visibilityBuffer || !pipelineState.pixelShader.Main ? RASTERIZATION_STATE_EARLY_DEPTH_TEST : 0;
+        }
+        stateBits |= pipelineState.depthWriteEnable ? RASTERIZATION_STATE_DEPTH_WRITE : 0;
+        stateBits |= pipelineState.hizBuffer ? RASTERIZATION_STATE_HIZ : 0;
+
+        RasterizationOutput output = RASTERIZATION_OUTPUT_NONE;
+        if (pipelineState.visibilityBuffer)
+        {
+            output = RASTERIZATION_OUTPUT_VISIBILITY_BUFFER;
+        }
+        else if (!pipelineState.pixelShader.Main)
+        {
+            output = RASTERIZATION_OUTPUT_DEPTH_ONLY;
+        }
+        else if (pipelineState.colorBuffer)
+        {
+            output = RASTERIZATION_OUTPUT_COLOR;
+        }
+        return stateBits | (output << RASTERIZATION_STATE_OUTPUT_SHIFT);
     }
 
     struct PixelShaderJobData
     {
-        BarycentricCoordinates barycentric;
-        const ShaderPayload* payload[3];
-        Vector3 screenPos[3];
+        // Interpolated pixel shader inputs of the quad, the shaded lane is quad.laneIndex
+        ShaderPayload payloads[SHADER_QUAD_SIZE];
+        // Outputs of PixelShader::MainQuad
+        Vector4 colors[SHADER_QUAD_SIZE];
+        PixelQuad quad;
+        float depth;
         int x, y;
-        float zNear, zFar;
         const GraphicsPipelineState* pipelineState;
         const void* pushConstants;
     };
 
-    static void LauchPixelShaderExecution(PixelShaderJobData* data)
+    static void StoreColor(RenderTarget<glm::u8vec4>* colorBuffer, int x, int y, Vector4 color)
     {
-        BarycentricCoordinates& barycentric = data->barycentric;
-        ShaderPayload payload;
+        color = glm::clamp(color, 0.0f, 1.0f);
+        glm::u8vec4 pixel = { (uint8)(color.x * 255.0f), (uint8)(color.y * 255.0f), (uint8)(color.z * 255.0f), (uint8)(color.w * 255.0f) };
+        colorBuffer->Store(x, y, pixel);
+    }
 
-        Vector3 screenPos[3] = { data->screenPos[0], data->screenPos[1], data->screenPos[2] };
+    // Returns true if the pixel was written to the depth buffer
+    template <uint32 StateBits>
+    static bool LauchPixelShaderExecution(PixelShaderJobData* data)
+    {
+        using State = RasterizationState<StateBits>;
+        const float depth = data->depth;
 
-        // Perspective-Correct Interpolation
-        payload.invW = BarycentricLerp(data->payload[0]->invW, data->payload[1]->invW, data->payload[2]->invW, barycentric, 1.0f);
-        const float w = 1.0f / payload.invW;
+        const ShaderPayload& payload = data->payloads[data->quad.laneIndex];
+        const PixelShader& pixelShader = data->pipelineState->pixelShader;
+        Vector4 color = pixelShader.MainQuad ? data->colors[data->quad.laneIndex] : pixelShader.Main(payload, data->quad, data->pushConstants);
 
-        Vector3 bc_clip = Vector3(barycentric.alpha * data->payload[0]->invW, barycentric.beta * data->payload[1]->invW, barycentric.gamma * data->payload[2]->invW);
-        bc_clip = bc_clip / (bc_clip.x + bc_clip.y + bc_clip.z);
-        const float depth = glm::dot(Vector3(screenPos[0].z, screenPos[1].z, screenPos[2].z), bc_clip);
-        //const float depth = glm::dot(Vector3(data->payload[0]->clipPosition.z, data->payload[1]->clipPosition.z, data->payload[2]->clipPosition.z), bc_clip);
-        //const float depth = BarycentricLerp(data->payload[0]->clipPosition.z * data->payload[0]->invW, data->payload[1]->clipPosition.z * data->payload[1]->invW, data->payload[2]->clipPosition.z * data->payload[2]->invW, barycentric, 1.0f);
-        
-        // Interpolate vertex attributes
-        payload.clipPosition = BarycentricLerp(data->payload[0]->clipPosition, data->payload[1]->clipPosition, data->payload[2]->clipPosition, barycentric, 1.0f);
-        payload.worldPosition = BarycentricLerp(data->payload[0]->worldPosition, data->payload[1]->worldPosition, data->payload[2]->worldPosition, barycentric, w);
-        payload.worldNormal = BarycentricLerp(data->payload[0]->worldNormal, data->payload[1]->worldNormal, data->payload[2]->worldNormal, barycentric, w);
-        payload.worldTangent = BarycentricLerp(data->payload[0]->worldTangent, data->payload[1]->worldTangent, data->payload[2]->worldTangent, barycentric, w);
-        payload.texCoord = BarycentricLerp(data->payload[0]->texCoord, data->payload[1]->texCoord, data->payload[2]->texCoord, barycentric, w);
+        // Late depth testing, the early test already rejected occluded pixels otherwise
+        if (State::lateDepthTest)
+        {
+            float depthBufferValue = data->pipelineState->depthBuffer->Load(data->x, data->y);
+            if (!DepthTest(State::depthCompareOp, depth, depthBufferValue))
+            {
+                return false;
+            }
+        }
 
-        Vector4 color = data->pipelineState->pixelShader.Main(payload, data->pushConstants);
+        if (State::output == RASTERIZATION_OUTPUT_COLOR)
+        {
+            StoreColor(data->pipelineState->colorBuffer, data->x, data->y, color);
+        }
+        // Depth writing
+        if (State::depthWrite)
+        {
+            data->pipelineState->depthBuffer->Store(data->x, data->y, depth);
+            return true;
+        }
+        return false;
+    }
+
+    FORCEINLINE static bool IsTopLeftEdge(int64 a, int64 b)
+    {
+        // With a positive triangle area the interior lies on the positive side of every edge,
+        // a left edge has the interior towards +x and a (horizontal) top edge towards +y.
+        return (a > 0) || (a == 0 && b > 0);
+    }
 
-        // Depth testing
-        if (data->pipelineState->depthTestEnable)
+    enum ClipPlane
+    {
+        CLIP_PLANE_NEAR,
+        CLIP_PLANE_LEFT,
+        CLIP_PLANE_RIGHT,
+        CLIP_PLANE_BOTTOM,
+        CLIP_PLANE_TOP,
+        CLIP_PLANE_COUNT,
+    };
+
+    // Signed distance to a clip plane in homogeneous clip space, inside is non-negative.
+    // The x/y planes are the guard band, not the viewport, so most triangles never need them.
+    FORCEINLINE static float ClipPlaneDistance(const Vector4& position, uint32 plane, const Vector2& guardBand)
+    {
+        switch (plane)
         {
-            float depthBufferValue = data->pipelineState->depthBuffer->Load(data->x, data->y);
-            if ((data->pipelineState->depthCompareOp == COMPARE_OP_LESS_OR_EQUAL) && (depth > depthBufferValue))
+        case CLIP_PLANE_NEAR:   return position.z;
+        case CLIP_PLANE_LEFT:   return position.x + guardBand.x * position.w;
+        case CLIP_PLANE_RIGHT:  return guardBand.x * position.w - position.x;
+        case CLIP_PLANE_BOTTOM: return position.y + guardBand.y * position.w;
+        case CLIP_PLANE_TOP:    return guardBand.y * position.w - position.y;
+        default:                return 0.0f;
+        }
+    }
+
+    static PostTransformVertex InterpolateClippedVertex(const VaryingPacking& packing, const PostTransformVertex& a, const PostTransformVertex& b, float t, ClippedVaryings& outVaryings)
+    {
+        PostTransformVertex vertex;
+        vertex.clipPosition = glm::mix(a.clipPosition, b.clipPosition, t);
+        vertex.varyings = outVaryings.data();
+        // Perspective-correct varyings are stored divided by w, undo it to interpolate in clip space
+        const float wa = a.clipPosition.w;
+        const float wb = b.clipPosition.w;
+        const float invW = 1.0f / vertex.clipPosition.w;
+        for (uint32 c = 0; c < packing.numComponents; c++)
+        {
+            const VaryingComponent& component = packing.components[c];
+            const float va = LoadVarying(component, a.varyings);
+            const float vb = LoadVarying(component, b.varyings);
+            float value;
+            if (component.interpolation == VARYING_INTERPOLATION_PERSPECTIVE)
             {
-                return;
+                value = Math::Lerp(va * wa, vb * wb, t) * invW;
             }
-            if ((data->pipelineState->depthCompareOp == COMPARE_OP_GREATER) && (depth <= depthBufferValue))
+            else
             {
-                return;
+                value = Math::Lerp(va, vb, t);
             }
+            StoreVarying(component, value, outVaryings.data());
         }
+        return vertex;
+    }
 
-        if (data->pipelineState->shadowMap)
+    // Sutherland-Hodgman clipping against the planes the triangle crosses, returns the number of polygon vertices.
+    static uint32 ClipTriangle(const PostTransformVertex triangle[3], const Vector2& guardBand, const VaryingPacking& packing, std::deque<ClippedVaryings>& clippedVaryings, PostTransformVertex outPolygon[RASTERIZER_MAX_CLIPPED_VERTICES])
+    {
+        PostTransformVertex polygon[RASTERIZER_MAX_CLIPPED_VERTICES];
+        uint32 numVertices = 3;
+        for (uint32 i = 0; i < 3; i++)
         {
-            float d = BarycentricLerp(data->payload[0]->clipPosition.z, data->payload[1]->clipPosition.z, data->payload[2]->clipPosition.z, barycentric, 1.0f);
-            //float d = depth;
-            d = data->zNear * data->zFar / (data->zFar + d * (data->zNear - data->zFar));
-            data->pipelineState->shadowMap->Store(data->x, data->y, d);
-            return;
+            outPolygon[i] = triangle[i];
         }
 
-        if (data->pipelineState->colorBuffer)
+        for (uint32 plane = 0; plane < CLIP_PLANE_COUNT; plane++)
         {
-            color = glm::clamp(color, 0.0f, 1.0f);
-            glm::u8vec4 pixel = { (uint8)(color.x * 255.0f), (uint8)(color.y * 255.0f), (uint8)(color.z * 255.0f), (uint8)(color.w * 255.0f) };
-            data->pipelineState->colorBuffer->Store(data->x, data->y, pixel);
+            float distance[RASTERIZER_MAX_CLIPPED_VERTICES];
+            bool crossing = false;
+            for (uint32 i = 0; i < numVertices; i++)
+            {
+                distance[i] = ClipPlaneDistance(outPolygon[i].clipPosition, plane, guardBand);
+                crossing = crossing || distance[i] < 0.0f;
+            }
+            if (!crossing)
+            {
+                continue;
+            }
+
+            uint32 numClippedVertices = 0;
+            for (uint32 i = 0; i < numVertices; i++)
+            {
+                const uint32 j = (i + 1) % numVertices;
+                if (distance[i] >= 0.0f)
+                {
+                    polygon[numClippedVertices++] = outPolygon[i];
+                }
+                if ((distance[i] >= 0.0f) != (distance[j] >= 0.0f))
+                {
+                    // Always interpolate from the inside vertex so shared edges produce the same vertex
+                    clippedVaryings.emplace_back();
+                    if (distance[i] >= 0.0f)
+                    {
+                        polygon[numClippedVertices++] = InterpolateClippedVertex(packing, outPolygon[i], outPolygon[j], distance[i] / (distance[i] - distance[j]), clippedVaryings.back());
+                    }
+                    else
+                    {
+                        polygon[numClippedVertices++] = InterpolateClippedVertex(packing, outPolygon[j], outPolygon[i], distance[j] / (distance[j] - distance[i]), clippedVaryings.back());
+                    }
+                }
+            }
+            if (numClippedVertices < 3)
+            {
+                return 0;
+            }
+            numVertices = numClippedVertices;
+            for (uint32 i = 0; i < numVertices; i++)
+            {
+                outPolygon[i] = polygon[i];
+            }
         }
-        // Depth writing
-        if (data->pipelineState->depthWriteEnable)
+        return numVertices;
+    }
+
+    static PlaneEquation SetupPlane(const float lambdaOrigin[3], const float lambdaStepX[3], const float lambdaStepY[3], float v0, float v1, float v2)
+    {
+        PlaneEquation plane;
+        plane.origin = lambdaOrigin[0] * v0 + lambdaOrigin[1] * v1 + lambdaOrigin[2] * v2;
+        plane.stepX = lambdaStepX[0] * v0 + lambdaStepX[1] * v1 + lambdaStepX[2] * v2;
+        plane.stepY = lambdaStepY[0] * v0 + lambdaStepY[1] * v1 + lambdaStepY[2] * v2;
+        return plane;
+    }
+
+    FORCEINLINE static float EvaluatePlane(const PlaneEquation& plane, float dx, float dy)
+    {
+        return plane.origin + dx * plane.stepX + dy * plane.stepY;
+    }
+
+    // Varying planes are appended to outAttributePlanes when the triangle is accepted, flat varyings
+    // take the values of provokingVaryings.
+    static bool SetupTriangle(const GraphicsPipelineState* pipelineState, const Viewport& viewport, uint32 subpixelBits, const VaryingPacking& packing, const PostTransformVertex& vertex0, const PostTransformVertex& vertex1, const PostTransformVertex& vertex2, const uint8* provokingVaryings, RasterTriangle& outTriangle, std::vector<PlaneEquation>& outAttributePlanes)
+    {
+        PostTransformVertex vertices[3] = { vertex0, vertex1, vertex2 };
+        float invW[3];
+        Vector3 ndcPos[3];
+        for (uint32 i = 0; i < 3; i++)
         {
-            data->pipelineState->depthBuffer->Store(data->x, data->y, depth);
+            invW[i] = 1.0f / vertices[i].clipPosition.w;
+            ndcPos[i] = Vector3(vertices[i].clipPosition) * invW[i];
+        }
+
+        // Viewport transform
+        Vector3* screenPos = outTriangle.screenPos;
+        for (uint32 i = 0; i < 3; i++)
+        {
+            screenPos[i].x = (viewport.width * 0.5f) * (1.0f + ndcPos[i].x) + viewport.x;
+            screenPos[i].y = (viewport.height * 0.5f) * (1.0f + ndcPos[i].y) + viewport.y;
+            screenPos[i].z = (viewport.maxDepth - viewport.minDepth) * ndcPos[i].z + viewport.minDepth;
+        }
+
+        // Snap to the sub-pixel grid. Edge equations are products of two fixed-point coordinates, 
+        // so coordinates are limited to 30 bits to keep them in 64-bit integers. Clipping to the
+        // guard band keeps vertices in range, this only catches degenerate clipped vertices.
+        const float subpixelScale = (float)(1 << subpixelBits);
+        const float maxCoordinate = (float)(1 << (30 - subpixelBits));
+        int64 X[3], Y[3];
+        for (uint32 i = 0; i < 3; i++)
+        {
+            if (!(Math::Abs(screenPos[i].x) < maxCoordinate && Math::Abs(screenPos[i].y) < maxCoordinate))
+            {
+                return false;
+            }
+            X[i] = (int64)std::llround((double)screenPos[i].x * subpixelScale);
+            Y[i] = (int64)std::llround((double)screenPos[i].y * subpixelScale);
+        }
+
+        int64 area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+        if (area == 0)
+        {
+            return false;
+        }
+
+        // Back-face culling in screen space
+        if (pipelineState->cullMode != CULL_MODE_NONE)
+        {
+            bool frontFacing = pipelineState->frontCCW ? area < 0 : area > 0;
+            if ((pipelineState->cullMode == CULL_MODE_BACK && !frontFacing) ||
+                (pipelineState->cullMode == CULL_MODE_FRONT && frontFacing) ||
+                (pipelineState->cullMode == CULL_MODE_FRONT_AND_BACK))
+            {
+                return false;
+            }
+        }
+
+        // Make the winding positive so that inside means all edge functions are non-negative
+        if (area < 0)
+        {
+            std::swap(X[1], X[2]);
+            std::swap(Y[1], Y[2]);
+            std::swap(screenPos[1], screenPos[2]);
+            std::swap(vertices[1], vertices[2]);
+            std::swap(invW[1], invW[2]);
+            area = -area;
+        }
+
+        // Scissor the bounding box to the viewport, guard band triangles can lie entirely outside it
+        const int viewportMaxX = (int)(viewport.x + viewport.width) - 1;
+        const int viewportMaxY = (int)(viewport.y + viewport.height) - 1;
+        if ((int)(std::max(X[0], std::max(X[1], X[2])) >> subpixelBits) < (int)viewport.x ||
+            (int)(std::min(X[0], std::min(X[1], X[2])) >> subpixelBits) > viewportMaxX ||
+            (int)(std::max(Y[0], std::max(Y[1], Y[2])) >> subpixelBits) < (int)viewport.y ||
+            (int)(std::min(Y[0], std::min(Y[1], Y[2])) >> subpixelBits) > viewportMaxY)
+        {
+            return false;
+        }
+        outTriangle.minx = std::clamp((int)(std::min(X[0], std::min(X[1], X[2])) >> subpixelBits), (int)viewport.x, viewportMaxX);
+        outTriangle.maxx = std::clamp((int)(std::max(X[0], std::max(X[1], X[2])) >> subpixelBits), (int)viewport.x, viewportMaxX);
+        outTriangle.miny = std::clamp((int)(std::min(Y[0], std::min(Y[1], Y[2])) >> subpixelBits), (int)viewport.y, viewportMaxY);
+        outTriangle.maxy = std::clamp((int)(std::max(Y[0], std::max(Y[1], Y[2])) >> subpixelBits), (int)viewport.y, viewportMaxY);
+
+        // Edge i is opposite to vertex i, w_i(p) = a_i * (p.x - X_j) + b_i * (p.y - Y_j)
+        const int64 sampleX = ((int64)outTriangle.minx << subpixelBits) + (1 << (subpixelBits - 1));
+        const int64 sampleY = ((int64)outTriangle.miny << subpixelBits) + (1 << (subpixelBits - 1));
+        for (uint32 i = 0; i < 3; i++)
+        {
+            const uint32 j = (i + 1) % 3;
+            const uint32 k = (i + 2) % 3;
+            const int64 a = Y[j] - Y[k];
+            const int64 b = X[k] - X[j];
+            const int64 bias = IsTopLeftEdge(a, b) ? 0 : -1;
+            outTriangle.edgeOrigin[i] = a * (sampleX - X[j]) + b * (sampleY - Y[j]) + bias;
+            outTriangle.edgeStepX[i] = a << subpixelBits;
+            outTriangle.edgeStepY[i] = b << subpixelBits;
+        }
+        // Screen space barycentrics are the normalized edge functions, every interpolated 
+        // quantity is then a plane set up once here instead of a per-pixel weighted sum
+        const float invArea = 1.0f / (float)area;
+        float lambdaOrigin[3], lambdaStepX[3], lambdaStepY[3];
+        for (uint32 i = 0; i < 3; i++)
+        {
+            lambdaOrigin[i] = (float)outTriangle.edgeOrigin[i] * invArea;
+            lambdaStepX[i] = (float)outTriangle.edgeStepX[i] * invArea;
+            lambdaStepY[i] = (float)outTriangle.edgeStepY[i] * invArea;
+            outTriangle.depth[i] = screenPos[i].z;
+        }
+        outTriangle.depthPlane = SetupPlane(lambdaOrigin, lambdaStepX, lambdaStepY, screenPos[0].z, screenPos[1].z, screenPos[2].z);
+        outTriangle.invWPlane = SetupPlane(lambdaOrigin, lambdaStepX, lambdaStepY, invW[0], invW[1], invW[2]);
+
+        outTriangle.firstAttributePlane = (uint32)outAttributePlanes.size();
+        for (uint32 c = 0; c < packing.numComponents; c++)
+        {
+            const VaryingComponent& component = packing.components[c];
+            if (component.interpolation == VARYING_INTERPOLATION_FLAT)
+            {
+                outAttributePlanes.push_back({ LoadVarying(component, provokingVaryings), 0.0f, 0.0f });
+            }
+            else
+            {
+                outAttributePlanes.push_back(SetupPlane(lambdaOrigin, lambdaStepX, lambdaStepY, LoadVarying(component, vertices[0].varyings), LoadVarying(component, vertices[1].varyings), LoadVarying(component, vertices[2].varyings)));
+            }
+        }
+
+        return true;
+    }
+
+    enum BlockCoverage
+    {
+        BLOCK_COVERAGE_NONE    = 0,
+        BLOCK_COVERAGE_PARTIAL = 1,
+        BLOCK_COVERAGE_FULL    = 2,
+    };
+
+    FORCEINLINE static int64 EvaluateEdge(const RasterTriangle& triangle, uint32 i, int x, int y)
+    {
+        return triangle.edgeOrigin[i] + (int64)(x - triangle.minx) * triangle.edgeStepX[i] + (int64)(y - triangle.miny) * triangle.edgeStepY[i];
+    }
+
+    // Edge functions are linear, so their extremes over a block are found at its corners.
+    static BlockCoverage ClassifyBlock(const RasterTriangle& triangle, int x, int y, int blockSize)
+    {
+        bool fullyCovered = true;
+        for (uint32 i = 0; i < 3; i++)
+        {
+            const int64 edge = EvaluateEdge(triangle, i, x, y);
+            const int64 extentX = triangle.edgeStepX[i] * (blockSize - 1);
+            const int64 extentY = triangle.edgeStepY[i] * (blockSize - 1);
+            if (edge + std::max(extentX, (int64)0) + std::max(extentY, (int64)0) < 0)
+            {
+                return BLOCK_COVERAGE_NONE;
+            }
+            fullyCovered = fullyCovered && (edge + std::min(extentX, (int64)0) + std::min(extentY, (int64)0) >= 0);
         }
+        return fullyCovered ? BLOCK_COVERAGE_FULL : BLOCK_COVERAGE_PARTIAL;
     }
 
-    struct TriangleRasterizationJobData
+    struct RasterizationContext;
+
+    using RasterizeTriangleFunc = void(*)(const RasterTriangle& triangle, const PlaneEquation* attributePlanes, int minx, int miny, int maxx, int maxy, const RasterizationContext& context);
+
+    struct RasterizationContext
     {
-        PixelShader shader;
-        uint32 primitiveID;
-        ShaderPayload* payload0;
-        ShaderPayload* payload1;
-        ShaderPayload* payload2;
+        EvaluatePixelRowFunc evaluatePixelRow;
+        // Kernel compiled for the state bits of pipelineState
+        RasterizeTriangleFunc rasterizeTriangle;
+        const GraphicsPipelineState* pipelineState;
         const void* pushConstants;
+        const VaryingPacking* varyingPacking;
+        HiZBuffer* hizBuffer;
+        RenderTarget<uint64>* visibilityBuffer;
+        uint32 drawID;
+    };
+
+    FORCEINLINE static uint64 PackVisibility(float depth, uint32 drawID, uint32 primitiveID)
+    {
+        return ((uint64)glm::floatBitsToUint(depth) << 32) | (drawID << RASTERIZER_VISIBILITY_PRIMITIVE_ID_BITS) | primitiveID;
+    }
+
+    struct BlockDepthWrites
+    {
+        uint32 numPixels;
+        float minDepth;
+        float maxDepth;
+    };
+
+    template <uint32 StateBits, bool TestCoverage>
+    static BlockDepthWrites RasterizeBlock(const RasterTriangle& triangle, const PlaneEquation* attributePlanes, int minx, int miny, int maxx, int maxy, const RasterizationContext& context)
+    {
+        using State = RasterizationState<StateBits>;
+        BlockDepthWrites depthWrites = { 0, FLT_MAX, -FLT_MAX };
+
+        // Pixels are shaded in 2x2 quads at even coordinates, so two rows are walked at once. Lanes
+        // outside [minx, maxx] x [miny, maxy] are never written, at most they become helper lanes.
+        const int quadMinX = minx & ~1;
+        const int quadMinY = miny & ~1;
+        int64 edgeRow[3];
+        for (uint32 i = 0; i < 3; i++)
+        {
+            edgeRow[i] = EvaluateEdge(triangle, i, quadMinX, quadMinY);
+        }
+
+        const VaryingPacking& packing = *context.varyingPacking;
+        PixelRow rows[2];
+        for (int y = quadMinY; y <= maxy; y += 2)
+        {
+            int64 edge[2][3];
+            for (uint32 i = 0; i < 3; i++)
+            {
+                edge[0][i] = edgeRow[i];
+                edge[1][i] = edgeRow[i] + triangle.edgeStepY[i];
+            }
+            for (int x = quadMinX; x <= maxx; x += RASTERIZER_PIXEL_ROW_WIDTH)
+            {
+                // Rows end on a whole quad, RASTERIZER_PIXEL_ROW_WIDTH is even
+                const uint32 numPixels = (uint32)std::min((maxx | 1) - x + 1, (int)RASTERIZER_PIXEL_ROW_WIDTH);
+                const uint32 columnMask = ((2u << std::min(maxx - x, (int)numPixels - 1)) - 1) & ~((1u << std::max(minx - x, 0)) - 1);
+                bool rowEvaluated[2];
+                for (uint32 r = 0; r < 2; r++)
+                {
+                    context.evaluatePixelRow(triangle, edge[r], x, y + (int)r, numPixels, TestCoverage, State::shadePixels, rows[r]);
+                    // Depth and w are only evaluated for rows with coverage
+                    rowEvaluated[r] = rows[r].coverageMask != 0;
+                    const int rowY = y + (int)r;
+                    rows[r].coverageMask = rowY >= miny && rowY <= maxy ? rows[r].coverageMask & columnMask : 0;
+                }
+
+                // Early depth testing, only pixels that survive are shaded
+                if (State::earlyDepthTest)
+                {
+                    const GraphicsPipelineState* pipelineState = context.pipelineState;
+                    for (uint32 r = 0; r < 2; r++)
+                    {
+                        for (uint32 coverageMask = rows[r].coverageMask; coverageMask != 0; coverageMask &= coverageMask - 1)
+                        {
+                            const uint32 i = (uint32)Math::CountTrailingZeros(coverageMask);
+                            if (!DepthTest(State::depthCompareOp, rows[r].depth[i], pipelineState->depthBuffer->Load(x + i, y + r)))
+                            {
+                                rows[r].coverageMask &= ~(1u << i);
+                            }
+                        }
+                    }
+                }
+
+                if (!State::shadePixels)
+                {
+                    // Geometry pass, shading is deferred to the visibility buffer resolve, or a depth-only pass
+                    const GraphicsPipelineState* pipelineState = context.pipelineState;
+                    for (uint32 r = 0; r < 2; r++)
+                    {
+                        for (uint32 coverageMask = rows[r].coverageMask; coverageMask != 0; coverageMask &= coverageMask - 1)
+                        {
+                            const uint32 i = (uint32)Math::CountTrailingZeros(coverageMask);
+                            if (State::output == RASTERIZATION_OUTPUT_VISIBILITY_BUFFER)
+                            {
+                                context.visibilityBuffer->Store(x + i, y + r, PackVisibility(rows[r].depth[i], context.drawID, triangle.primitiveID));
+                            }
+                            if (State::depthWrite)
+                            {
+                                pipelineState->depthBuffer->Store(x + i, y + r, rows[r].depth[i]);
+                                depthWrites.numPixels++;
+                                depthWrites.minDepth = std::min(depthWrites.minDepth, rows[r].depth[i]);
+                                depthWrites.maxDepth = std::max(depthWrites.maxDepth, rows[r].depth[i]);
+                            }
+                        }
+                        rows[r].coverageMask = 0;
+                    }
+                }
+
+                // Bit 2 * q is set for every quad q with at least one pixel to shade
+                const uint32 liveMask = rows[0].coverageMask | rows[1].coverageMask;
+                const uint32 quadMask = (liveMask | (liveMask >> 1)) & 0x55555555u;
+                if (quadMask != 0)
+                {
+                    // Helper lanes need w of a row that had no coverage
+                    for (uint32 r = 0; r < 2; r++)
+                    {
+                        if (!rowEvaluated[r])
+                        {
+                            const uint32 coverageMask = rows[r].coverageMask;
+                            context.evaluatePixelRow(triangle, edge[r], x, y + (int)r, numPixels, false, true, rows[r]);
+                            rows[r].coverageMask = coverageMask;
+                        }
+                    }
+                }
+
+                // Varying planes are evaluated once per row of pixels and stepped to each pixel
+                float attributeRow[2][SHADER_MAX_VARYING_COMPONENTS];
+                if (quadMask != 0)
+                {
+                    for (uint32 c = 0; c < packing.numComponents; c++)
+                    {
+                        attributeRow[0][c] = EvaluatePlane(attributePlanes[c], (float)(x - triangle.minx), (float)(y - triangle.miny));
+                        attributeRow[1][c] = attributeRow[0][c] + attributePlanes[c].stepY;
+                    }
+                }
+
+                for (uint32 quads = quadMask; quads != 0; quads &= quads - 1)
+                {
+                    const uint32 column = (uint32)Math::CountTrailingZeros(quads);
+                    const uint32 laneMask = ((rows[0].coverageMask >> column) & 3) | (((rows[1].coverageMask >> column) & 3) << 2);
+
+                    PixelShaderJobData pixelShaderJobData;
+                    for (uint32 lane = 0; lane < SHADER_QUAD_SIZE; lane++)
+                    {
+                        const uint32 r = lane >> 1;
+                        const uint32 i = column + (lane & 1);
+                        float attributes[SHADER_MAX_VARYING_COMPONENTS];
+                        for (uint32 c = 0; c < packing.numComponents; c++)
+                        {
+                            attributes[c] = attributeRow[r][c] + (float)i * attributePlanes[c].stepX;
+                        }
+                        UnpackVaryings(packing, attributes, rows[r].w[i], pixelShaderJobData.payloads[lane]);
+                    }
+                    pixelShaderJobData.quad.lanes = pixelShaderJobData.payloads;
+                    pixelShaderJobData.quad.laneIndex = 0;
+                    pixelShaderJobData.quad.helperMask = ~laneMask & 0xF;
+                    pixelShaderJobData.pipelineState = context.pipelineState;
+                    pixelShaderJobData.pushConstants = context.pushConstants;
+                    if (context.pipelineState->pixelShader.MainQuad)
+                    {
+                        context.pipelineState->pixelShader.MainQuad(pixelShaderJobData.quad, laneMask, context.pushConstants, pixelShaderJobData.colors);
+                    }
+
+                    for (uint32 lanes = laneMask; lanes != 0; lanes &= lanes - 1)
+                    {
+                        const uint32 lane = (uint32)Math::CountTrailingZeros(lanes);
+                        const uint32 r = lane >> 1;
+                        const uint32 i = column + (lane & 1);
+                        pixelShaderJobData.quad.laneIndex = lane;
+                        pixelShaderJobData.depth = rows[r].depth[i];
+                        pixelShaderJobData.x = x + (int)i;
+                        pixelShaderJobData.y = y + (int)r;
+                        if (LauchPixelShaderExecution<StateBits>(&pixelShaderJobData))
+                        {
+                            depthWrites.numPixels++;
+                            depthWrites.minDepth = std::min(depthWrites.minDepth, rows[r].depth[i]);
+                            depthWrites.maxDepth = std::max(depthWrites.maxDepth, rows[r].depth[i]);
+                        }
+                    }
+                }
+
+                for (uint32 r = 0; r < 2; r++)
+                {
+                    edge[r][0] += triangle.edgeStepX[0] * RASTERIZER_PIXEL_ROW_WIDTH;
+                    edge[r][1] += triangle.edgeStepX[1] * RASTERIZER_PIXEL_ROW_WIDTH;
+                    edge[r][2] += triangle.edgeStepX[2] * RASTERIZER_PIXEL_ROW_WIDTH;
+                }
+            }
+            edgeRow[0] += triangle.edgeStepY[0] * 2;
+            edgeRow[1] += triangle.edgeStepY[1] * 2;
+            edgeRow[2] += triangle.edgeStepY[2] * 2;
+        }
+        return depthWrites;
+    }
+
+    static_assert((int)RASTERIZER_BLOCK_SIZE == (int)HIZ_BLOCK_SIZE, "Hi-Z blocks must match rasterizer blocks");
+
+    // Depth is planar in screen space, so its extremes over a block are found at its corners.
+    // The block is rejected if even the nearest depth of the triangle fails against the farthest stored depth.
+    template <CompareOp DepthCompareOp>
+    static bool HiZTestBlock(const RasterTriangle& triangle, int blockX, int blockY, const HiZBuffer* hizBuffer)
+    {
+        const float depth = EvaluatePlane(triangle.depthPlane, (float)(blockX - triangle.minx), (float)(blockY - triangle.miny));
+        const float extentX = triangle.depthPlane.stepX * (RASTERIZER_BLOCK_SIZE - 1);
+        const float extentY = triangle.depthPlane.stepY * (RASTERIZER_BLOCK_SIZE - 1);
+        const float minDepth = std::max(depth + std::min(extentX, 0.0f) + std::min(extentY, 0.0f), std::min(triangle.depth[0], std::min(triangle.depth[1], triangle.depth[2])));
+        const float maxDepth = std::min(depth + std::max(extentX, 0.0f) + std::max(extentY, 0.0f), std::max(triangle.depth[0], std::max(triangle.depth[1], triangle.depth[2])));
+        const uint32 hizX = (uint32)blockX / HIZ_BLOCK_SIZE;
+        const uint32 hizY = (uint32)blockY / HIZ_BLOCK_SIZE;
+        switch (DepthCompareOp)
+        {
+        case COMPARE_OP_LESS_OR_EQUAL:
+            return minDepth <= hizBuffer->LoadMaxDepth(hizX, hizY);
+        case COMPARE_OP_GREATER:
+            return maxDepth > hizBuffer->LoadMinDepth(hizX, hizY);
+        default:
+            return true;
+        }
+    }
+
+    static void UpdateHiZBlock(int blockX, int blockY, const BlockDepthWrites& depthWrites, const GraphicsPipelineState* pipelineState, HiZBuffer* hizBuffer)
+    {
+        const uint32 hizX = (uint32)blockX / HIZ_BLOCK_SIZE;
+        const uint32 hizY = (uint32)blockY / HIZ_BLOCK_SIZE;
+        const uint32 numBlockPixels =
+            std::min(pipelineState->depthBuffer->GetWidth() - (uint32)blockX, (uint32)HIZ_BLOCK_SIZE) *
+            std::min(pipelineState->depthBuffer->GetHeight() - (uint32)blockY, (uint32)HIZ_BLOCK_SIZE);
+        if (depthWrites.numPixels == numBlockPixels)
+        {
+            // The whole block was overwritten, the bounds can shrink
+            hizBuffer->Store(hizX, hizY, depthWrites.minDepth, depthWrites.maxDepth);
+        }
+        else
+        {
+            hizBuffer->Store(hizX, hizY,
+                std::min(hizBuffer->LoadMinDepth(hizX, hizY), depthWrites.minDepth),
+                std::max(hizBuffer->LoadMaxDepth(hizX, hizY), depthWrites.maxDepth));
+        }
+    }
+
+    template <uint32 StateBits>
+    static void RasterizeTriangle(const RasterTriangle& triangle, const PlaneEquation* attributePlanes, int minx, int miny, int maxx, int maxy, const RasterizationContext& context)
+    {
+        using State = RasterizationState<StateBits>;
+        // Hierarchical traversal: coarse blocks, then blocks, are trivially rejected or accepted 
+        // from their corners and only partially covered blocks are tested per pixel.
+        const int coarseBlockMask = ~(RASTERIZER_COARSE_BLOCK_SIZE - 1);
+        for (int coarseY = miny & coarseBlockMask; coarseY <= maxy; coarseY += RASTERIZER_COARSE_BLOCK_SIZE)
+        {
+            for (int coarseX = minx & coarseBlockMask; coarseX <= maxx; coarseX += RASTERIZER_COARSE_BLOCK_SIZE)
+            {
+                BlockCoverage coarseCoverage = ClassifyBlock(triangle, coarseX, coarseY, RASTERIZER_COARSE_BLOCK_SIZE);
+                if (coarseCoverage == BLOCK_COVERAGE_NONE)
+                {
+                    continue;
+                }
+                if (coarseCoverage == BLOCK_COVERAGE_FULL && !State::hiz)
+                {
+                    RasterizeBlock<StateBits, false>(
+                        triangle,
+                        attributePlanes,
+                        std::max(coarseX, minx),
+                        std::max(coarseY, miny),
+                        std::min(coarseX + RASTERIZER_COARSE_BLOCK_SIZE - 1, maxx),
+                        std::min(coarseY + RASTERIZER_COARSE_BLOCK_SIZE - 1, maxy),
+                        context);
+                    continue;
+                }
+                for (int blockY = std::max(coarseY, miny & ~(RASTERIZER_BLOCK_SIZE - 1)); blockY < std::min(coarseY + RASTERIZER_COARSE_BLOCK_SIZE, maxy + 1); blockY += RASTERIZER_BLOCK_SIZE)
+                {
+                    for (int blockX = std::max(coarseX, minx & ~(RASTERIZER_BLOCK_SIZE - 1)); blockX < std::min(coarseX + RASTERIZER_COARSE_BLOCK_SIZE, maxx + 1); blockX += RASTERIZER_BLOCK_SIZE)
+                    {
+                        BlockCoverage coverage = coarseCoverage == BLOCK_COVERAGE_FULL ? BLOCK_COVERAGE_FULL : ClassifyBlock(triangle, blockX, blockY, RASTERIZER_BLOCK_SIZE);
+                        if (coverage == BLOCK_COVERAGE_NONE)
+                        {
+                            continue;
+                        }
+                        if (State::hizTest && !HiZTestBlock<State::depthCompareOp>(triangle, blockX, blockY, context.hizBuffer))
+                        {
+                            continue;
+                        }
+                        const int x0 = std::max(blockX, minx);
+                        const int y0 = std::max(blockY, miny);
+                        const int x1 = std::min(blockX + RASTERIZER_BLOCK_SIZE - 1, maxx);
+                        const int y1 = std::min(blockY + RASTERIZER_BLOCK_SIZE - 1, maxy);
+                        BlockDepthWrites depthWrites;
+                        if (coverage == BLOCK_COVERAGE_FULL)
+                        {
+                            depthWrites = RasterizeBlock<StateBits, false>(triangle, attributePlanes, x0, y0, x1, y1, context);
+                        }
+                        else
+                        {
+                            depthWrites = RasterizeBlock<StateBits, true>(triangle, attributePlanes, x0, y0, x1, y1, context);
+                        }
+                        if (State::hizUpdate && depthWrites.numPixels > 0)
+                        {
+                            UpdateHiZBlock(blockX, blockY, depthWrites, context.pipelineState, context.hizBuffer);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    template <uint32... StateBits>
+    static constexpr std::array<RasterizeTriangleFunc, sizeof...(StateBits)> MakeRasterizeTriangleTable(std::integer_sequence<uint32, StateBits...>)
+    {
+        return { { &RasterizeTriangle<StateBits>... } };
+    }
+
+    // One kernel per combination of RasterizationStateBits
+    static const std::array<RasterizeTriangleFunc, RASTERIZATION_STATE_COUNT> rasterizeTriangleKernels = MakeRasterizeTriangleTable(std::make_integer_sequence<uint32, RASTERIZATION_STATE_COUNT>());
+
+    // Pipeline compile step: picks the kernel specialized for the state of a draw
+    static RasterizeTriangleFunc CompileRasterizationKernel(const GraphicsPipelineState& pipelineState)
+    {
+        return rasterizeTriangleKernels[GetRasterizationStateBits(pipelineState)];
+    }
+
+    struct TriangleBinningJobData
+    {
+        TriangleBin* bin;
+        const std::vector<Primitive>* primitives;
+        const Vector4* clipPositions;
+        const uint8* varyings;
+        const VaryingPacking* varyingPacking;
+        uint32 firstPrimitiveID;
+        uint32 numPrimitives;
+        uint32 numTilesX;
+        uint32 numTilesY;
+        uint32 subpixelBits;
         const GraphicsPipelineState* pipelineState;
         Viewport viewport;
         float zNear;
         float zFar;
     };
 
-    static void ExecuteTriangleRasterization(TriangleRasterizationJobData* data)
+    static void ExecuteTriangleBinning(TriangleBinningJobData* data)
     {
-        ShaderPayload* payload0 = data->payload0;
-        ShaderPayload* payload1 = data->payload1;
-        ShaderPayload* payload2 = data->payload2;
+        TriangleBin& bin = *data->bin;
+        const uint32 numTiles = data->numTilesX * data->numTilesY;
+        const int tileOriginX = (int)data->viewport.x;
+        const int tileOriginY = (int)data->viewport.y;
 
-        Vector4 clipPosition[3] = { data->payload0->clipPosition, data->payload1->clipPosition, data->payload2->clipPosition };
-        Vector3 ndcPos[3] = { data->payload0->ndcPosition, data->payload1->ndcPosition, data->payload2->ndcPosition };
+        // Guard band in NDC units, half of the fixed-point range around the viewport
+        const float guardBandSize = (float)(1 << (29 - data->subpixelBits));
+        const Vector2 guardBand = Vector2(guardBandSize / (data->viewport.width * 0.5f), guardBandSize / (data->viewport.height * 0.5f));
 
-        if (!ClipSpacaeCulling(clipPosition[0], clipPosition[1], clipPosition[2], data->zNear, data->zFar))
+        bin.triangles.clear();
+        bin.clippedVaryings.clear();
+        bin.attributePlanes.clear();
+        const VaryingPacking& packing = *data->varyingPacking;
+        for (uint32 primitiveID = data->firstPrimitiveID; primitiveID < data->firstPrimitiveID + data->numPrimitives; primitiveID++)
         {
-            return;
+            const Primitive& primitive = (*data->primitives)[primitiveID];
+            PostTransformVertex vertices[3];
+            for (uint32 i = 0; i < 3; i++)
+            {
+                vertices[i].clipPosition = data->clipPositions[primitive.indices[i]];
+                vertices[i].varyings = data->varyings + primitive.indices[i] * packing.stride;
+            }
+            if (!ClipSpacaeCulling(vertices[0].clipPosition, vertices[1].clipPosition, vertices[2].clipPosition, data->zNear, data->zFar))
+            {
+                continue;
+            }
+
+            PostTransformVertex polygon[RASTERIZER_MAX_CLIPPED_VERTICES];
+            const uint32 numVertices = ClipTriangle(vertices, guardBand, packing, bin.clippedVaryings, polygon);
+            for (uint32 i = 1; i + 1 < numVertices; i++)
+            {
+                RasterTriangle triangle;
+                if (SetupTriangle(data->pipelineState, data->viewport, data->subpixelBits, packing, polygon[0], polygon[i], polygon[i + 1], vertices[0].varyings, triangle, bin.attributePlanes))
+                {
+                    triangle.primitiveID = primitiveID;
+                    bin.triangles.push_back(triangle);
+                }
+            }
         }
 
-        // Viewport transform
-        Vector3 screenPos[3];
-        for (uint32 i = 0; i < 3; i++)
+        // Counting sort by tile, stable so every tile sees its triangles in submission order
+        bin.tileOffsets.assign(numTiles + 1, 0);
+        for (const RasterTriangle& triangle : bin.triangles)
+        {
+            for (int tileY = (triangle.miny - tileOriginY) / RASTERIZER_TILE_SIZE; tileY <= (triangle.maxy - tileOriginY) / RASTERIZER_TILE_SIZE; tileY++)
+            {
+                for (int tileX = (triangle.minx - tileOriginX) / RASTERIZER_TILE_SIZE; tileX <= (triangle.maxx - tileOriginX) / RASTERIZER_TILE_SIZE; tileX++)
+                {
+                    bin.tileOffsets[tileY * data->numTilesX + tileX + 1]++;
+                }
+            }
+        }
+        for (uint32 tileIndex = 0; tileIndex < numTiles; tileIndex++)
         {
-            screenPos[i].x = (data->viewport.width * 0.5f) * (1.0f + ndcPos[i].x) + data->viewport.x;
-            screenPos[i].y = (data->viewport.height * 0.5f) * (1.0f + ndcPos[i].y) + data->viewport.y;
-            screenPos[i].z = (data->viewport.maxDepth - data->viewport.minDepth) * ndcPos[i].z + data->viewport.minDepth;
+            bin.tileOffsets[tileIndex + 1] += bin.tileOffsets[tileIndex];
         }
 
-        // Back-face culling in screen space
-        if (data->pipelineState->cullMode != CULL_MODE_NONE)
+        bin.triangleIndices.resize(bin.tileOffsets[numTiles]);
+        for (uint32 triangleIndex = 0; triangleIndex < (uint32)bin.triangles.size(); triangleIndex++)
         {
-            auto e1 = Vector2(screenPos[2]) - Vector2(screenPos[0]);
-            auto e2 = Vector2(screenPos[1]) - Vector2(screenPos[0]);
-            float orient = e1.x * e2.y - e1.y * e2.x;
-            bool frontFacing = data->pipelineState->frontCCW ? orient > 0.0f : orient < 0.0f;
-            if ((data->pipelineState->cullMode == CULL_MODE_BACK && !frontFacing) ||
-                (data->pipelineState->cullMode == CULL_MODE_FRONT && frontFacing) ||
-                (data->pipelineState->cullMode == CULL_MODE_FRONT_AND_BACK))
+            const RasterTriangle& triangle = bin.triangles[triangleIndex];
+            for (int tileY = (triangle.miny - tileOriginY) / RASTERIZER_TILE_SIZE; tileY <= (triangle.maxy - tileOriginY) / RASTERIZER_TILE_SIZE; tileY++)
             {
-                return;
+                for (int tileX = (triangle.minx - tileOriginX) / RASTERIZER_TILE_SIZE; tileX <= (triangle.maxx - tileOriginX) / RASTERIZER_TILE_SIZE; tileX++)
+                {
+                    bin.triangleIndices[bin.tileOffsets[tileY * data->numTilesX + tileX]++] = triangleIndex;
+                }
             }
         }
-        
-        int minx = std::clamp(std::min((int)screenPos[0].x, std::min((int)screenPos[1].x, (int)screenPos[2].x)), (int)data->viewport.x, (int)data->viewport.width  - 1);
-        int maxx = std::clamp(std::max((int)screenPos[0].x, std::max((int)screenPos[1].x, (int)screenPos[2].x)), (int)data->viewport.x, (int)data->viewport.width  - 1);
-        int miny = std::clamp(std::min((int)screenPos[0].y, std::min((int)screenPos[1].y, (int)screenPos[2].y)), (int)data->viewport.y, (int)data->viewport.height - 1);
-        int maxy = std::clamp(std::max((int)screenPos[0].y, std::max((int)screenPos[1].y, (int)screenPos[2].y)), (int)data->viewport.y, (int)data->viewport.height - 1);
+        // The scatter above advanced every offset to the start of the next tile, shift them back
+        for (uint32 tileIndex = numTiles; tileIndex > 0; tileIndex--)
+        {
+            bin.tileOffsets[tileIndex] = bin.tileOffsets[tileIndex - 1];
+        }
+        bin.tileOffsets[0] = 0;
+    }
 
-#pragma omp parallel for
-        for (int x = minx; x <= maxx; x++)
+    struct TileRasterizationJobData
+    {
+        const TriangleBin* bins;
+        uint32 numBins;
+        uint32 tileIndex;
+        int minx, miny, maxx, maxy;
+        RasterizationContext context;
+    };
+
+    static void ExecuteTileRasterization(TileRasterizationJobData* data)
+    {
+        // Bins are visited in submission order, so overlapping triangles resolve exactly like a serial draw
+        for (uint32 binIndex = 0; binIndex < data->numBins; binIndex++)
         {
-            for (int y = miny; y <= maxy; y++)
+            const TriangleBin& bin = data->bins[binIndex];
+            for (uint32 i = bin.tileOffsets[data->tileIndex]; i < bin.tileOffsets[data->tileIndex + 1]; i++)
             {
-                BarycentricCoordinates barycentric = CalculateBarycentric2D((float)x, (float)y, screenPos[0], screenPos[1], screenPos[2]);
-                if (!barycentric.IsInsideTriangle())
+                const RasterTriangle& triangle = bin.triangles[bin.triangleIndices[i]];
+                data->context.rasterizeTriangle(
+                    triangle,
+                    &bin.attributePlanes[triangle.firstAttributePlane],
+                    std::max(triangle.minx, data->minx),
+                    std::max(triangle.miny, data->miny),
+                    std::min(triangle.maxx, data->maxx),
+                    std::min(triangle.maxy, data->maxy),
+                    data->context);
+            }
+        }
+    }
+
+    struct VisibilityBufferResolveJobData
+    {
+        const RenderTarget<uint64>* visibilityBuffer;
+        const VisibilityBufferDraw* draws;
+        int minx, miny, maxx, maxy;
+    };
+
+    static void ExecuteVisibilityBufferResolve(VisibilityBufferResolveJobData* data)
+    {
+        const uint32 primitiveIDMask = (1u << RASTERIZER_VISIBILITY_PRIMITIVE_ID_BITS) - 1;
+        for (int y = data->miny; y <= data->maxy; y++)
+        {
+            for (int x = data->minx; x <= data->maxx; x++)
+            {
+                const uint64 visibility = data->visibilityBuffer->Load(x, y);
+                if ((uint32)visibility == 0xFFFFFFFF)
                 {
                     continue;
                 }
+                const VisibilityBufferDraw& draw = data->draws[(uint32)visibility >> RASTERIZER_VISIBILITY_PRIMITIVE_ID_BITS];
+                const Primitive& primitive = (*draw.primitives)[(uint32)visibility & primitiveIDMask];
+                const Vector4* clipPosition[3];
+                const uint8* varyings[3];
+                for (uint32 i = 0; i < 3; i++)
+                {
+                    clipPosition[i] = &draw.clipPositions[primitive.indices[i]];
+                    varyings[i] = &draw.varyings[primitive.indices[i] * draw.varyingPacking.stride];
+                }
 
-                PixelShaderJobData pixelShaderJobData = {
-                    barycentric,
-                    { payload0, payload1, payload2 },
-                    { screenPos[0], screenPos[1], screenPos[2] },
-                    x, y,
-                    data->zNear, data->zFar,
-                    data->pipelineState,
-                    data->pushConstants
-                };
-                LauchPixelShaderExecution(&pixelShaderJobData);
+                Vector3 c[3];
+                for (uint32 i = 0; i < 3; i++)
+                {
+                    c[i] = Vector3(clipPosition[i]->x, clipPosition[i]->y, clipPosition[i]->w);
+                }
+                const Vector3 edgeNormals[3] = { glm::cross(c[1], c[2]), glm::cross(c[2], c[0]), glm::cross(c[0], c[1]) };
+
+                // The pixel is lane 0 of a quad whose helper lanes evaluate the same triangle one pixel
+                // to the right and below, which gives the pixel shader analytic derivatives. Derivatives
+                // of lane 0 never read lane 3, so it is left uninterpolated.
+                ShaderPayload payloads[SHADER_QUAD_SIZE];
+                for (uint32 lane = 0; lane < SHADER_QUAD_SIZE - 1; lane++)
+                {
+                    // Barycentrics of the pixel center from the 2D homogeneous clip space positions (x, y, w):
+                    // M * (lambda_i / w_i) is proportional to (ndc.x, ndc.y, 1), so no projected vertex is needed
+                    const Vector3 p = Vector3(
+                        ((float)(x + (lane & 1)) + 0.5f - draw.viewport.x) / (draw.viewport.width * 0.5f) - 1.0f,
+                        ((float)(y + (lane >> 1)) + 0.5f - draw.viewport.y) / (draw.viewport.height * 0.5f) - 1.0f,
+                        1.0f);
+                    float lambda[3] = {
+                        glm::dot(p, edgeNormals[0]) * clipPosition[0]->w,
+                        glm::dot(p, edgeNormals[1]) * clipPosition[1]->w,
+                        glm::dot(p, edgeNormals[2]) * clipPosition[2]->w
+                    };
+                    const float invSum = 1.0f / (lambda[0] + lambda[1] + lambda[2]);
+                    lambda[0] *= invSum;
+                    lambda[1] *= invSum;
+                    lambda[2] *= invSum;
+
+                    const float w = 1.0f / (lambda[0] / clipPosition[0]->w + lambda[1] / clipPosition[1]->w + lambda[2] / clipPosition[2]->w);
+                    InterpolateVaryings(draw.varyingPacking, varyings, { lambda[0], lambda[1], lambda[2] }, w, payloads[lane]);
+                }
+                const PixelQuad quad = { payloads, 0, 0xE };
+                Vector4 color = draw.pipelineState.pixelShader.Main(payloads[0], quad, draw.pushConstants);
+                if (draw.pipelineState.colorBuffer)
+                {
+                    StoreColor(draw.pipelineState.colorBuffer, x, y, color);
+                }
             }
         }
     }
 
     void Rasterizer::DrawPrimitives(const GraphicsPipelineState& pipelineState, const void* pushConstants, uint32 numVertices, const std::vector<Primitive>& primitives, uint32 numPrimitives, float zNear, float zFar)
     {
-        payloads.resize(numVertices);
+        if (pipelineState.visibilityBuffer)
+        {
+            ASSERT(visibilityBufferDraws.size() < RASTERIZER_MAX_VISIBILITY_BUFFER_DRAWS);
+            ASSERT(numPrimitives <= (1u << RASTERIZER_VISIBILITY_PRIMITIVE_ID_BITS));
+            ASSERT(pipelineState.pixelShader.Main);
+            // Texels are overwritten by every fragment that passes, only the depth buffer keeps the nearest
+            ASSERT(pipelineState.depthTestEnable && pipelineState.depthWriteEnable);
+        }
+        if (pipelineState.hizBuffer)
+        {
+            // Hi-Z blocks are indexed by pixel and tiles start at the viewport origin, a block must not be
+            // shared by two tiles rasterized at the same time
+            ASSERT((int)viewport.x % HIZ_BLOCK_SIZE == 0 && (int)viewport.y % HIZ_BLOCK_SIZE == 0);
+        }
+
+        // Depth-only pipelines interpolate no varyings, post-transform vertices are just clip positions
+        const VaryingLayout& varyingLayout = !pipelineState.pixelShader.Main ? emptyVaryingLayout :
+            pipelineState.pixelShader.varyingLayout ? *pipelineState.pixelShader.varyingLayout : defaultVaryingLayout;
+        const VaryingPacking varyingPacking = CreateVaryingPacking(varyingLayout);
+        clipPositions.resize(numVertices);
+        varyings.resize((size_t)numVertices * varyingPacking.stride);
 
         std::vector<JobDecl> jobDecls;
 
-        // Launch vertex shaders
-        std::vector<VertexShaderJobData> vertexShaderExecuteJobData(numVertices);
-        jobDecls.resize(numVertices);
-        for (uint32 vertexID = 0; vertexID < numVertices; vertexID++) 
+        // Launch vertex shaders, one job per batch of vertices
+        const uint32 numVertexBatches = (numVertices + vertexBatchSize - 1) / vertexBatchSize;
+        std::vector<VertexShaderJobData> vertexShaderExecuteJobData(numVertexBatches);
+        jobDecls.resize(numVertexBatches);
+        for (uint32 batchIndex = 0; batchIndex < numVertexBatches; batchIndex++) 
         {
-            vertexShaderExecuteJobData[vertexID] = {
+            const uint32 firstVertexID = batchIndex * vertexBatchSize;
+            vertexShaderExecuteJobData[batchIndex] = {
                 pipelineState.vertexShader,
-                vertexID, 
-                &payloads[vertexID], 
+                firstVertexID,
+                std::min(vertexBatchSize, numVertices - firstVertexID),
+                &varyingPacking,
+                &clipPositions[firstVertexID],
+                &varyings[(size_t)firstVertexID * varyingPacking.stride],
                 pushConstants
             };
-            jobDecls[vertexID] = { 
+            jobDecls[batchIndex] = { 
                 JOB_SYSTEM_JOB_ENTRY_POINT(LaunchVertexShaderExecution), 
-                &vertexShaderExecuteJobData[vertexID]
+                &vertexShaderExecuteJobData[batchIndex]
             };
         }
-        JobSystemAtomicCounterHandle vertexShaderExecuteJobCounter = JobSystem::RunJobs(jobDecls.data(), numVertices);
+        JobSystemAtomicCounterHandle vertexShaderExecuteJobCounter = JobSystem::RunJobs(jobDecls.data(), numVertexBatches);
         JobSystem::WaitForCounterAndFreeWithoutFiber(vertexShaderExecuteJobCounter);
 
-        // Rasterization stage
-        std::vector<TriangleRasterizationJobData> triangleRasterizeJobData(numPrimitives);
-        jobDecls.resize(numPrimitives);
-        for (uint32 primitiveID = 0; primitiveID < numPrimitives; primitiveID++)
-        {
-            triangleRasterizeJobData[primitiveID] = { 
-                pipelineState.pixelShader,
-                primitiveID, 
-                &payloads[primitives[primitiveID].indices[0]], 
-                &payloads[primitives[primitiveID].indices[1]],
-                &payloads[primitives[primitiveID].indices[2]],
-                pushConstants,
+        // Binning stage: set up triangles in batches and sort them into screen tiles
+        const uint32 numBins = (numPrimitives + RASTERIZER_BINNING_BATCH_SIZE - 1) / RASTERIZER_BINNING_BATCH_SIZE;
+        if (bins.size() < numBins)
+        {
+            bins.resize(numBins);
+        }
+        std::vector<TriangleBinningJobData> triangleBinningJobData(numBins);
+        jobDecls.resize(numBins);
+        for (uint32 binIndex = 0; binIndex < numBins; binIndex++)
+        {
+            const uint32 firstPrimitiveID = binIndex * RASTERIZER_BINNING_BATCH_SIZE;
+            triangleBinningJobData[binIndex] = {
+                &bins[binIndex],
+                &primitives,
+                clipPositions.data(),
+                varyings.data(),
+                &varyingPacking,
+                firstPrimitiveID,
+                std::min((uint32)RASTERIZER_BINNING_BATCH_SIZE, numPrimitives - firstPrimitiveID),
+                numTilesX,
+                numTilesY,
+                subpixelBits,
                 &pipelineState,
                 viewport,
                 zNear,
                 zFar
             };
-            jobDecls[primitiveID] = {
-                JOB_SYSTEM_JOB_ENTRY_POINT(ExecuteTriangleRasterization),
-                &triangleRasterizeJobData[primitiveID]
+            jobDecls[binIndex] = {
+                JOB_SYSTEM_JOB_ENTRY_POINT(ExecuteTriangleBinning),
+                &triangleBinningJobData[binIndex]
+            };
+        }
+        JobSystemAtomicCounterHandle triangleBinningJobCounter = JobSystem::RunJobs(jobDecls.data(), numBins);
+        JobSystem::WaitForCounterAndFreeWithoutFiber(triangleBinningJobCounter);
+
+        // Rasterization stage: one job per non-empty tile
+        static const EvaluatePixelRowFunc evaluatePixelRow = GetEvaluatePixelRowFunc();
+        const RasterizationContext context = {
+            evaluatePixelRow,
+            CompileRasterizationKernel(pipelineState),
+            &pipelineState,
+            pushConstants,
+            &varyingPacking,
+            pipelineState.hizBuffer,
+            pipelineState.visibilityBuffer,
+            (uint32)visibilityBufferDraws.size()
+        };
+        std::vector<TileRasterizationJobData> tileRasterizeJobData;
+        tileRasterizeJobData.reserve(numTilesX * numTilesY);
+        for (uint32 tileY = 0; tileY < numTilesY; tileY++)
+        {
+            for (uint32 tileX = 0; tileX < numTilesX; tileX++)
+            {
+                const uint32 tileIndex = tileY * numTilesX + tileX;
+                bool empty = true;
+                for (uint32 binIndex = 0; binIndex < numBins && empty; binIndex++)
+                {
+                    empty = bins[binIndex].tileOffsets[tileIndex] == bins[binIndex].tileOffsets[tileIndex + 1];
+                }
+                if (empty)
+                {
+                    continue;
+                }
+                const int minx = (int)viewport.x + tileX * RASTERIZER_TILE_SIZE;
+                const int miny = (int)viewport.y + tileY * RASTERIZER_TILE_SIZE;
+                tileRasterizeJobData.push_back({
+                    bins.data(),
+                    numBins,
+                    tileIndex,
+                    minx, miny,
+                    minx + RASTERIZER_TILE_SIZE - 1,
+                    miny + RASTERIZER_TILE_SIZE - 1,
+                    context
+                });
+            }
+        }
+        const uint32 numTileJobs = (uint32)tileRasterizeJobData.size();
+        jobDecls.resize(numTileJobs);
+        for (uint32 jobIndex = 0; jobIndex < numTileJobs; jobIndex++)
+        {
+            jobDecls[jobIndex] = {
+                JOB_SYSTEM_JOB_ENTRY_POINT(ExecuteTileRasterization),
+                &tileRasterizeJobData[jobIndex]
             };
-            ExecuteTriangleRasterization(&triangleRasterizeJobData[primitiveID]);
         }
-        JobSystemAtomicCounterHandle triangleRasterizeJobCounter = JobSystem::RunJobs(jobDecls.data(), numPrimitives);
-        JobSystem::WaitForCounterAndFreeWithoutFiber(triangleRasterizeJobCounter);
+        JobSystemAtomicCounterHandle tileRasterizeJobCounter = JobSystem::RunJobs(jobDecls.data(), numTileJobs);
+        JobSystem::WaitForCounterAndFreeWithoutFiber(tileRasterizeJobCounter);
+
+        if (pipelineState.visibilityBuffer)
+        {
+            // Vertex outputs are needed again when the pixels of this draw are shaded
+            visibilityBufferDraws.push_back({
+                pipelineState,
+                pushConstants,
+                &primitives,
+                varyingPacking,
+                std::move(clipPositions),
+                std::move(varyings),
+                viewport,
+                zNear,
+                zFar
+            });
+        }
+    }
+
+    void Rasterizer::ResolveVisibilityBuffer(const RenderTarget<uint64>* visibilityBuffer)
+    {
+        // Every pixel is shaded exactly once, so equally sized tiles are equally expensive jobs
+        const int maxx = std::min((int)(viewport.x + viewport.width), (int)visibilityBuffer->GetWidth()) - 1;
+        const int maxy = std::min((int)(viewport.y + viewport.height), (int)visibilityBuffer->GetHeight()) - 1;
+        std::vector<VisibilityBufferResolveJobData> resolveJobData(numTilesX * numTilesY);
+        std::vector<JobDecl> jobDecls(numTilesX * numTilesY);
+        for (uint32 tileY = 0; tileY < numTilesY; tileY++)
+        {
+            for (uint32 tileX = 0; tileX < numTilesX; tileX++)
+            {
+                const uint32 tileIndex = tileY * numTilesX + tileX;
+                const int minx = (int)viewport.x + tileX * RASTERIZER_TILE_SIZE;
+                const int miny = (int)viewport.y + tileY * RASTERIZER_TILE_SIZE;
+                resolveJobData[tileIndex] = {
+                    visibilityBuffer,
+                    visibilityBufferDraws.data(),
+                    minx, miny,
+                    std::min(minx + RASTERIZER_TILE_SIZE - 1, maxx),
+                    std::min(miny + RASTERIZER_TILE_SIZE - 1, maxy)
+                };
+                jobDecls[tileIndex] = {
+                    JOB_SYSTEM_JOB_ENTRY_POINT(ExecuteVisibilityBufferResolve),
+                    &resolveJobData[tileIndex]
+                };
+            }
+        }
+        JobSystemAtomicCounterHandle resolveJobCounter = JobSystem::RunJobs(jobDecls.data(), numTilesX * numTilesY);
+        JobSystem::WaitForCounterAndFreeWithoutFiber(resolveJobCounter);
+
+        visibilityBufferDraws.clear();
     }
 
     void Rasterizer::SetViewport(float x, float y, float width, float height)
@@ -325,5 +1352,19 @@ namespace SR
         viewport.height = height;
         viewport.minDepth = 0.0f;
         viewport.maxDepth = 1.0f;
+        numTilesX = ((uint32)width + RASTERIZER_TILE_SIZE - 1) / RASTERIZER_TILE_SIZE;
+        numTilesY = ((uint32)height + RASTERIZER_TILE_SIZE - 1) / RASTERIZER_TILE_SIZE;
+    }
+
+    void Rasterizer::SetSubpixelPrecision(uint32 bits)
+    {
+        ASSERT(bits == 4 || bits == 8);
+        subpixelBits = bits;
+    }
+
+    void Rasterizer::SetVertexBatchSize(uint32 size)
+    {
+        ASSERT(size > 0);
+        vertexBatchSize = size;
     }
 }
\ No newline at end of file
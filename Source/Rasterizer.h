@@ -7,6 +7,25 @@
 
 namespace SR
 {
+    enum
+    {
+        RASTERIZER_TILE_SIZE = 64,
+        RASTERIZER_COARSE_BLOCK_SIZE = 16,
+        RASTERIZER_BLOCK_SIZE = 8,
+        RASTERIZER_BINNING_BATCH_SIZE = 1024,
+        RASTERIZER_DEFAULT_VERTEX_BATCH_SIZE = 512,
+        // Vertices a job shades at a time into its stack, a multiple of the vector width of batch vertex shaders
+        RASTERIZER_VERTEX_SHADER_CHUNK_SIZE = 64,
+        RASTERIZER_DEFAULT_SUBPIXEL_BITS = 8,
+        // A triangle clipped by the near plane and the four guard band planes
+        RASTERIZER_MAX_CLIPPED_VERTICES = 3 + 5,
+        // Visibility buffer texels hold the depth bits in the high 32 bits and
+        // (drawID << RASTERIZER_VISIBILITY_PRIMITIVE_ID_BITS) | primitiveID in the low 32 bits.
+        // A cleared texel (all bits set) is empty, so the last draw ID is reserved.
+        RASTERIZER_VISIBILITY_PRIMITIVE_ID_BITS = 24,
+        RASTERIZER_MAX_VISIBILITY_BUFFER_DRAWS = (1 << (32 - RASTERIZER_VISIBILITY_PRIMITIVE_ID_BITS)) - 1,
+    };
+
     enum FillMode
     {
         FILL_MODE_SOLID          = 0,
@@ -31,6 +50,8 @@ namespace SR
     {
         // Shaders
         VertexShader vertexShader;
+        // Without Main the pipeline is depth-only: no varyings are interpolated and only depth is
+        // tested and written, as for shadow maps and depth prepasses
         PixelShader pixelShader;
         // Rasterization state
         FillMode fillMode;
@@ -40,9 +61,18 @@ namespace SR
         bool depthTestEnable;
         bool depthWriteEnable;
         CompareOp depthCompareOp;
+        // Depth test before the pixel shader runs, disable for shaders that discard or modify depth
+        bool earlyDepthTestEnable = true;
         RenderTarget<float>* depthBuffer;
         RenderTarget<glm::u8vec4>* colorBuffer;
-        RenderTarget<float>* shadowMap = nullptr;
+        // Optional block depth bounds of depthBuffer, rejects occluded blocks before per-pixel work. Must be
+        // bound to every draw that writes depthBuffer, and the viewport origin must then be a multiple of
+        // HIZ_BLOCK_SIZE.
+        HiZBuffer* hizBuffer = nullptr;
+        // Geometry pass of visibility buffer rendering: IDs and depth are written instead of running
+        // the pixel shader, which runs once per pixel in Rasterizer::ResolveVisibilityBuffer. Requires depth
+        // testing and depth writes, the depth buffer decides which fragment a texel keeps.
+        RenderTarget<uint64>* visibilityBuffer = nullptr;
     };
 
     //struct RasterizerStatatics
@@ -60,13 +90,109 @@ namespace SR
         float maxDepth;
     };
 
+    // Screen space plane f = origin + (x - minx) * stepX + (y - miny) * stepY of a triangle, with
+    // (x, y) a pixel and origin the value at the center of pixel (minx, miny) of its bounding box
+    struct PlaneEquation
+    {
+        float origin;
+        float stepX;
+        float stepY;
+    };
+
+    // Location of one interpolated component in ShaderPayload and in a packed post-transform vertex
+    struct VaryingComponent
+    {
+        uint32 payloadOffset;
+        uint32 packedOffset;
+        VaryingInterpolation interpolation;
+        bool halfPrecision;
+    };
+
+    // Post-transform vertices keep only the varyings of the pixel shader, packed with this layout.
+    // Perspective-correct components are stored divided by w.
+    struct VaryingPacking
+    {
+        uint32 numComponents;
+        uint32 stride;
+        VaryingComponent components[SHADER_MAX_VARYING_COMPONENTS];
+    };
+
+    struct PostTransformVertex
+    {
+        Vector4 clipPosition;
+        const uint8* varyings;
+    };
+
+    // Varyings of a vertex created by clipping
+    using ClippedVaryings = std::array<uint8, SHADER_MAX_VARYING_COMPONENTS * sizeof(float)>;
+
+    struct RasterTriangle
+    {
+        Vector3 screenPos[3];
+        // Screen space bounding box, clamped to the viewport
+        int minx, miny, maxx, maxy;
+        // Fixed-point edge functions evaluated at the center of pixel (minx, miny), including the 
+        // top-left fill rule bias, and their increments for one pixel step in x and y
+        int64 edgeOrigin[3];
+        int64 edgeStepX[3];
+        int64 edgeStepY[3];
+        // Per-vertex depth, and the depth and 1/w planes
+        float depth[3];
+        PlaneEquation depthPlane;
+        PlaneEquation invWPlane;
+        // Planes of the packed varying components, in TriangleBin::attributePlanes
+        uint32 firstAttributePlane;
+        uint32 primitiveID;
+    };
+
+    // Triangles set up by one binning job, sorted by the screen tiles they overlap.
+    struct TriangleBin
+    {
+        std::vector<RasterTriangle> triangles;
+        // Triangles of tile i are triangleIndices[tileOffsets[i], tileOffsets[i + 1])
+        std::vector<uint32> tileOffsets;
+        std::vector<uint32> triangleIndices;
+        std::vector<PlaneEquation> attributePlanes;
+        // Varyings of vertices created by clipping, a deque keeps pointers to them valid
+        std::deque<ClippedVaryings> clippedVaryings;
+    };
+
+    // A draw of the visibility buffer geometry pass, kept until its pixels are shaded
+    struct VisibilityBufferDraw
+    {
+        GraphicsPipelineState pipelineState;
+        const void* pushConstants;
+        const std::vector<Primitive>* primitives;
+        VaryingPacking varyingPacking;
+        std::vector<Vector4> clipPositions;
+        std::vector<uint8> varyings;
+        Viewport viewport;
+        float zNear;
+        float zFar;
+    };
+
     class Rasterizer
     {
     public:
-        std::vector<ShaderPayload> payloads;
         void SetViewport(float x, float y, float width, float height); 
+        // Number of sub-pixel bits used to snap vertex positions, 4 or 8
+        void SetSubpixelPrecision(uint32 bits);
+        // Number of vertices shaded by one job
+        void SetVertexBatchSize(uint32 size);
         void DrawPrimitives(const GraphicsPipelineState& pipelineState, const void* pushConstants, uint32 numVertices, const std::vector<Primitive>& primitives, uint32 numPrimitives, float zNear, float zFar);
+        // Runs the pixel shader once per covered pixel of the visibility buffer for the draws recorded
+        // since the last resolve, their push constants and primitives must still be alive.
+        void ResolveVisibilityBuffer(const RenderTarget<uint64>* visibilityBuffer);
     private:
         Viewport viewport;
+        uint32 numTilesX;
+        uint32 numTilesY;
+        uint32 subpixelBits = RASTERIZER_DEFAULT_SUBPIXEL_BITS;
+        uint32 vertexBatchSize = RASTERIZER_DEFAULT_VERTEX_BATCH_SIZE;
+        std::vector<TriangleBin> bins;
+        // Post-transform vertices of the current draw
+        std::vector<Vector4> clipPositions;
+        std::vector<uint8> varyings;
+        std::vector<VisibilityBufferDraw> visibilityBufferDraws;
     };
 }
\ No newline at end of file
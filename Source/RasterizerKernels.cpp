@@ -0,0 +1,109 @@
+#include "RasterizerKernels.h"
+#include "CPUFeatures.h"
+
+#include <emmintrin.h>
+
+namespace SR
+{
+    void EvaluatePixelRowScalar(const RasterTriangle& triangle, const int64 edge[3], int x, int y, uint32 numPixels, bool testCoverage, bool evaluateW, PixelRow& outRow)
+    {
+        uint32 coverageMask = 0;
+        int64 w0 = edge[0];
+        int64 w1 = edge[1];
+        int64 w2 = edge[2];
+        for (uint32 i = 0; i < numPixels; i++)
+        {
+            if (!testCoverage || (w0 | w1 | w2) >= 0)
+            {
+                coverageMask |= 1u << i;
+            }
+            w0 += triangle.edgeStepX[0];
+            w1 += triangle.edgeStepX[1];
+            w2 += triangle.edgeStepX[2];
+        }
+        outRow.coverageMask = coverageMask;
+        if (coverageMask == 0)
+        {
+            return;
+        }
+
+        const float dx = (float)(x - triangle.minx);
+        const float dy = (float)(y - triangle.miny);
+        const float invWOrigin = triangle.invWPlane.origin + dx * triangle.invWPlane.stepX + dy * triangle.invWPlane.stepY;
+        const float depthOrigin = triangle.depthPlane.origin + dx * triangle.depthPlane.stepX + dy * triangle.depthPlane.stepY;
+        for (uint32 i = 0; i < numPixels; i++)
+        {
+            outRow.depth[i] = depthOrigin + (float)i * triangle.depthPlane.stepX;
+        }
+        if (evaluateW)
+        {
+            for (uint32 i = 0; i < numPixels; i++)
+            {
+                outRow.w[i] = 1.0f / (invWOrigin + (float)i * triangle.invWPlane.stepX);
+            }
+        }
+    }
+
+    void EvaluatePixelRowSSE2(const RasterTriangle& triangle, const int64 edge[3], int x, int y, uint32 numPixels, bool testCoverage, bool evaluateW, PixelRow& outRow)
+    {
+        const uint32 validMask = (1u << numPixels) - 1;
+        uint32 coverageMask = validMask;
+        if (testCoverage)
+        {
+            // Exact 64-bit edge functions, two pixels per register, sign bit set means outside
+            __m128i outside[4] = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+            for (uint32 e = 0; e < 3; e++)
+            {
+                const int64 step = triangle.edgeStepX[e];
+                const __m128i step2 = _mm_set1_epi64x(step * 2);
+                __m128i value = _mm_add_epi64(_mm_set1_epi64x(edge[e]), _mm_set_epi64x(step, 0));
+                for (uint32 i = 0; i < 4; i++)
+                {
+                    outside[i] = _mm_or_si128(outside[i], value);
+                    value = _mm_add_epi64(value, step2);
+                }
+            }
+            uint32 outsideMask = 0;
+            for (uint32 i = 0; i < 4; i++)
+            {
+                outsideMask |= (uint32)_mm_movemask_pd(_mm_castsi128_pd(outside[i])) << (i * 2);
+            }
+            coverageMask = ~outsideMask & validMask;
+        }
+        outRow.coverageMask = coverageMask;
+        if (coverageMask == 0)
+        {
+            return;
+        }
+
+        const float dx = (float)(x - triangle.minx);
+        const float dy = (float)(y - triangle.miny);
+        const __m128 invWOrigin = _mm_set1_ps(triangle.invWPlane.origin + dx * triangle.invWPlane.stepX + dy * triangle.invWPlane.stepY);
+        const __m128 depthOrigin = _mm_set1_ps(triangle.depthPlane.origin + dx * triangle.depthPlane.stepX + dy * triangle.depthPlane.stepY);
+        const __m128 laneOffset[2] = { _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), _mm_set_ps(7.0f, 6.0f, 5.0f, 4.0f) };
+        for (uint32 half = 0; half < 2; half++)
+        {
+            const __m128 depth = _mm_add_ps(depthOrigin, _mm_mul_ps(laneOffset[half], _mm_set1_ps(triangle.depthPlane.stepX)));
+            _mm_storeu_ps(&outRow.depth[half * 4], depth);
+            if (evaluateW)
+            {
+                const __m128 invW = _mm_add_ps(invWOrigin, _mm_mul_ps(laneOffset[half], _mm_set1_ps(triangle.invWPlane.stepX)));
+                _mm_storeu_ps(&outRow.w[half * 4], _mm_div_ps(_mm_set1_ps(1.0f), invW));
+            }
+        }
+    }
+
+    EvaluatePixelRowFunc GetEvaluatePixelRowFunc()
+    {
+        const CPUFeatures& features = GetCPUFeatures();
+        if (features.avx2 && features.fma)
+        {
+            return EvaluatePixelRowAVX2;
+        }
+        if (features.sse2)
+        {
+            return EvaluatePixelRowSSE2;
+        }
+        return EvaluatePixelRowScalar;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "SRCommon.h"
+#include "Rasterizer.h"
+
+namespace SR
+{
+    enum
+    {
+        RASTERIZER_PIXEL_ROW_WIDTH = 8,
+    };
+
+    // Up to RASTERIZER_PIXEL_ROW_WIDTH horizontally adjacent pixels of one triangle.
+    struct PixelRow
+    {
+        uint32 coverageMask;
+        float depth[RASTERIZER_PIXEL_ROW_WIDTH];
+        // Perspective-correct w, 1 / interpolated 1/w
+        float w[RASTERIZER_PIXEL_ROW_WIDTH];
+    };
+
+    // Evaluates coverage, depth and w of numPixels pixels starting at pixel (x, y), whose edge function
+    // values are edge[]. When testCoverage is false the pixels are known to be inside. Without evaluateW
+    // w is left undefined, passes that shade no pixels only need depth.
+    using EvaluatePixelRowFunc = void(*)(const RasterTriangle& triangle, const int64 edge[3], int x, int y, uint32 numPixels, bool testCoverage, bool evaluateW, PixelRow& outRow);
+
+    extern void EvaluatePixelRowScalar(const RasterTriangle& triangle, const int64 edge[3], int x, int y, uint32 numPixels, bool testCoverage, bool evaluateW, PixelRow& outRow);
+    extern void EvaluatePixelRowSSE2(const RasterTriangle& triangle, const int64 edge[3], int x, int y, uint32 numPixels, bool testCoverage, bool evaluateW, PixelRow& outRow);
+    extern void EvaluatePixelRowAVX2(const RasterTriangle& triangle, const int64 edge[3], int x, int y, uint32 numPixels, bool testCoverage, bool evaluateW, PixelRow& outRow);
+
+    // Picks the widest kernel supported by the CPU.
+    extern EvaluatePixelRowFunc GetEvaluatePixelRowFunc();
+}
\ No newline at end of file
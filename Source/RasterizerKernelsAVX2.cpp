@@ -0,0 +1,48 @@
+#include "RasterizerKernels.h"
+
+#include <immintrin.h>
+
+// This translation unit is built with AVX2 code generation and must only be entered after a CPU check.
+namespace SR
+{
+    void EvaluatePixelRowAVX2(const RasterTriangle& triangle, const int64 edge[3], int x, int y, uint32 numPixels, bool testCoverage, bool evaluateW, PixelRow& outRow)
+    {
+        const uint32 validMask = (1u << numPixels) - 1;
+        uint32 coverageMask = validMask;
+        if (testCoverage)
+        {
+            // Exact 64-bit edge functions, pixels 0-3 and 4-7, sign bit set means outside
+            __m256i outsideLo = _mm256_setzero_si256();
+            __m256i outsideHi = _mm256_setzero_si256();
+            for (uint32 e = 0; e < 3; e++)
+            {
+                const int64 step = triangle.edgeStepX[e];
+                const __m256i valueLo = _mm256_add_epi64(_mm256_set1_epi64x(edge[e]), _mm256_set_epi64x(step * 3, step * 2, step, 0));
+                const __m256i valueHi = _mm256_add_epi64(valueLo, _mm256_set1_epi64x(step * 4));
+                outsideLo = _mm256_or_si256(outsideLo, valueLo);
+                outsideHi = _mm256_or_si256(outsideHi, valueHi);
+            }
+            const uint32 outsideMask = (uint32)_mm256_movemask_pd(_mm256_castsi256_pd(outsideLo)) | ((uint32)_mm256_movemask_pd(_mm256_castsi256_pd(outsideHi)) << 4);
+            coverageMask = ~outsideMask & validMask;
+        }
+        outRow.coverageMask = coverageMask;
+        if (coverageMask == 0)
+        {
+            return;
+        }
+
+        // Plane values at the first pixel, then one step per lane
+        const float dx = (float)(x - triangle.minx);
+        const float dy = (float)(y - triangle.miny);
+        const float depthOrigin = triangle.depthPlane.origin + dx * triangle.depthPlane.stepX + dy * triangle.depthPlane.stepY;
+        const __m256 laneOffset = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+        const __m256 depth = _mm256_fmadd_ps(laneOffset, _mm256_set1_ps(triangle.depthPlane.stepX), _mm256_set1_ps(depthOrigin));
+        _mm256_storeu_ps(outRow.depth, depth);
+        if (evaluateW)
+        {
+            const float invWOrigin = triangle.invWPlane.origin + dx * triangle.invWPlane.stepX + dy * triangle.invWPlane.stepY;
+            const __m256 invW = _mm256_fmadd_ps(laneOffset, _mm256_set1_ps(triangle.invWPlane.stepX), _mm256_set1_ps(invWOrigin));
+            _mm256_storeu_ps(outRow.w, _mm256_div_ps(_mm256_set1_ps(1.0f), invW));
+        }
+    }
+}
\ No newline at end of file
@@ -10,4 +10,10 @@ enum DebugView
     DEBUG_VIEW_METALLIC   = 4,
     DEBUG_VIEW_ROUGHNESS  = 5,
     DEBUG_VIEW_DEPTH      = 6,
+};
+
+enum ShadowType
+{
+    SHADOW_TYPE_PCF  = 0,
+    SHADOW_TYPE_EVSM = 1,
 };
\ No newline at end of file
@@ -10,10 +10,15 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtx/compatibility.hpp>
 #include <glm/gtx/matrix_decompose.hpp>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #define ONE_PI 				  (3.1415926535897932f)	
 #define INV_PI			      (0.31830988618f)
 #define HALF_PI			      (1.57079632679f)
@@ -131,6 +136,18 @@ namespace Math
         return (value > 0) && ((value & (value - 1)) == 0);
     }
 
+    FORCEINLINE uint32 CountTrailingZeros(uint32 value)
+    {
+        ASSERT(value != 0);
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return (uint32)index;
+#else
+        return (uint32)__builtin_ctz(value);
+#endif
+    }
+
     FORCEINLINE Matrix4x4 Transpose(const Matrix4x4& matrix)
     {
         return glm::transpose(matrix);
@@ -155,7 +172,7 @@ namespace Math
 
     FORCEINLINE uint32_t MaxMipLevelCount(uint32_t width, uint32_t height)
     {
-        return 1 + uint32_t(std::floor(std::log2(glm::min(width, height))));
+        return 1 + uint32_t(std::floor(std::log2(glm::max(width, height))));
     }
 
     FORCEINLINE float Clamp(float x, float min = 0, float max = 1)
@@ -14,67 +14,69 @@ SR_ENABLE_WARNINGS
 
 namespace SR
 {
-	bool LoadTextureFromFile(const char* filename, Texture* texure)
+	// Two channel formats keep the channels firstChannel and firstChannel + 1 of the image
+	bool LoadTextureFromFile(const char* filename, TextureFormat format, Texture* texure, uint32 firstChannel = 0)
 	{
 		SR_LOG_INFO("Import texture: {0}", filename);
 
+		// Every image is expanded to 4 channels, grey is replicated to RGB and alpha defaults to 255
 		int iw = 0, ih = 0, c = 0;
 		stbi_set_flip_vertically_on_load(true);
-		unsigned char* data = stbi_load(filename, &iw, &ih, &c, STBI_default);
+		unsigned char* data = stbi_load(filename, &iw, &ih, &c, STBI_rgb_alpha);
 		if (data == nullptr) 
 		{
 			return false;
 		}
-		texure->Resize(iw, ih);
-
-		for (uint32 y = 0; y < (uint32)ih; y++)
+		// BC1 has no alpha, images that are not opaque are compressed to BC3 instead
+		if (format == TEXTURE_FORMAT_BC1_UNORM || format == TEXTURE_FORMAT_BC1_SRGB)
 		{
-			for (uint32 x = 0; x < (uint32)iw; x++)
+			for (int i = 0; i < iw * ih; i++)
 			{
-				glm::u8vec4 pixel;
-				uint32 idx = x + y * iw;
-
-				switch (c) 
+				if (data[i * 4 + 3] != 255)
 				{
-				case STBI_grey:
-				{
-					pixel.r = data[idx];
-					pixel.g = pixel.b = pixel.r;
-					pixel.a = 255;
+					format = IsSRGBFormat(format) ? TEXTURE_FORMAT_BC3_SRGB : TEXTURE_FORMAT_BC3_UNORM;
 					break;
 				}
-				case STBI_grey_alpha:
-				{
-					pixel.r = data[idx * 2 + 0];
-					pixel.g = pixel.b = pixel.r;
-					pixel.a = data[idx * 2 + 1];
-					break;
-				}
-				case STBI_rgb: 
-				{
-					pixel.r = data[idx * 3 + 0];
-					pixel.g = data[idx * 3 + 1];
-					pixel.b = data[idx * 3 + 2];
-					pixel.a = 255;
-					break;
-				}
-				case STBI_rgb_alpha:
+			}
+		}
+		if (firstChannel != 0)
+		{
+			for (int i = 0; i < iw * ih; i++)
+			{
+				data[i * 4 + 0] = data[i * 4 + firstChannel];
+				data[i * 4 + 1] = data[i * 4 + firstChannel + 1];
+			}
+		}
+		// Block-compressed textures are mipmapped uncompressed, then compressed
+		const TextureFormat loadFormat = IsBlockCompressedFormat(format) ? (IsSRGBFormat(format) ? TEXTURE_FORMAT_RGBA8_SRGB : TEXTURE_FORMAT_RGBA8_UNORM) : format;
+		// Tiled keeps the 2D footprint of a pixel quad within a few cache lines
+		texure->Resize(iw, ih, loadFormat, TEXTURE_LAYOUT_TILED);
+
+		if (loadFormat == TEXTURE_FORMAT_RGBA8_UNORM || loadFormat == TEXTURE_FORMAT_RGBA8_SRGB)
+		{
+			// Already in the texture format
+			texure->SetData(data);
+		}
+		else
+		{
+			for (uint32 y = 0; y < (uint32)ih; y++)
+			{
+				for (uint32 x = 0; x < (uint32)iw; x++)
 				{
-					pixel.r = data[idx * 4 + 0];
-					pixel.g = data[idx * 4 + 1];
-					pixel.b = data[idx * 4 + 2];
-					pixel.a = data[idx * 4 + 3];
-					break;
-				}
-				default: break;
+					const unsigned char* pixel = data + (x + y * iw) * 4;
+					texure->StoreTexel(x, y, Vector4(pixel[0] / 255.0f, pixel[1] / 255.0f, pixel[2] / 255.0f, pixel[3] / 255.0f));
 				}
-
-				texure->StoreTexel(x, y, Vector4(pixel.r / 255.0f, pixel.g / 255.0f, pixel.b / 255.0f, pixel.a / 255.0f));
 			}
 		}
 
 		stbi_image_free(data);
 
+		texure->GenerateMips(MIP_FILTER_KAISER);
+		if (loadFormat != format)
+		{
+			texure->Compress(format);
+		}
+
 		return true;
 	}
 
@@ -122,6 +124,7 @@ namespace SR
 				return false;
 			}
 
+			mesh->bounds = BoundingBox();
 			mesh->positions.resize(aiMesh->mNumVertices);
 			mesh->normals.resize(aiMesh->mNumVertices);
 			mesh->tangents.resize(aiMesh->mNumVertices);
@@ -129,6 +132,7 @@ namespace SR
 			for (uint32 j = 0; j < aiMesh->mNumVertices; j++)
 			{
 				mesh->positions[j] = Vector3(aiMesh->mVertices[j].x, aiMesh->mVertices[j].y, aiMesh->mVertices[j].z);
+				mesh->bounds.Expand(mesh->positions[j]);
 				mesh->normals[j] = Vector3(aiMesh->mNormals[j].x, aiMesh->mNormals[j].y, aiMesh->mNormals[j].z);
 				mesh->tangents[j] = Vector3(aiMesh->mTangents[j].x, aiMesh->mTangents[j].y, aiMesh->mTangents[j].z);
 				if (aiMesh->HasTextureCoords(0))
@@ -177,7 +181,7 @@ namespace SR
 					material.baseColor = Vector4(1.0f, 1.0f, 1.0f, 1.0f);
 					std::string absolutePath = dir + '/' + aiTexPath.C_Str();
 					material.baseColorMap = (std::shared_ptr<Texture>)new Texture();
-					LoadTextureFromFile(absolutePath.c_str(), material.baseColorMap.get());
+					LoadTextureFromFile(absolutePath.c_str(), TEXTURE_FORMAT_BC1_SRGB, material.baseColorMap.get());
 				}
 				else
 				{
@@ -190,7 +194,7 @@ namespace SR
 				{
 					std::string absolutePath = dir + '/' + aiTexPath.C_Str();
 					material.normalMap = (std::shared_ptr<Texture>)new Texture();
-					LoadTextureFromFile(absolutePath.c_str(), material.normalMap.get());
+					LoadTextureFromFile(absolutePath.c_str(), TEXTURE_FORMAT_BC5_UNORM, material.normalMap.get());
 				}
 				else
 				{
@@ -203,7 +207,9 @@ namespace SR
 					material.metallic = 1.0f; material.roughness = 1.0f;
 					std::string absolutePath = dir + '/' + aiTexPath.C_Str();
 					material.metallicRoughnessMap = (std::shared_ptr<Texture>)new Texture();
-					LoadTextureFromFile(absolutePath.c_str(), material.metallicRoughnessMap.get());
+					// Roughness (G) and metallic (B) are independent, BC5 compresses them separately where BC1 would fit
+					// them to one color line
+					LoadTextureFromFile(absolutePath.c_str(), TEXTURE_FORMAT_BC5_UNORM, material.metallicRoughnessMap.get(), 1);
 				}
 				else
 				{
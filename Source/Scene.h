@@ -23,22 +23,47 @@ namespace SR
         Vector3 rotation;
         Vector3 scale;
         Matrix4x4 world;
+        // Casts its shadow into the cached static layer of the shadow map
+        bool isStatic = false;
     };
 
+    struct BoundingBox
+    {
+        Vector3 min = Vector3(FLOAT_MAX);
+        Vector3 max = Vector3(-FLOAT_MAX);
+        void Expand(const Vector3& point)
+        {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+        void Expand(const BoundingBox& box)
+        {
+            min = glm::min(min, box.min);
+            max = glm::max(max, box.max);
+        }
+        Vector3 GetCorner(uint32 index) const
+        {
+            return Vector3((index & 1) ? max.x : min.x, (index & 2) ? max.y : min.y, (index & 4) ? max.z : min.z);
+        }
+        // Box around the transformed corners
+        BoundingBox Transform(const Matrix4x4& matrix) const
+        {
+            BoundingBox box;
+            for (uint32 i = 0; i < 8; i++)
+            {
+                box.Expand(Vector3(matrix * Vector4(GetCorner(i), 1.0f)));
+            }
+            return box;
+        }
+    };
+
+    // Shadows are cast along direction, by the cascades of the shadow map
     struct DirectionalLight
     {
         Vector3 color;
         float intensity;
         Vector3 position;
         Vector3 direction;
-        Matrix4x4 vp;
-        void Update()
-        {
-            Matrix4x4 view = glm::lookAt(position, position + direction, Vector3(0.0f, 1.0f, 0.0f));
-            Matrix4x4 projection = glm::perspective(Math::DegreesToRadians(45.0f), 1.0f, 3.0f, 70.0f);
-            //Matrix4x4 projection = glm::ortho(0.0f, 512.0f, 0.1f, 256.0f);
-            vp = projection * view;// glm::scale(glm::mat4(1.0f), Vector3(0.01f, 0.01f, 0.01f));
-        }
     };
 
     struct PBRMaterial
@@ -63,6 +88,8 @@ namespace SR
         std::vector<Vector3> normals;
         std::vector<Vector2> texCoords;
         std::vector<Primitive> primitives;
+        // Of the positions, in object space
+        BoundingBox bounds;
 
         PBRMaterial material;
     };
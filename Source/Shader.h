@@ -7,6 +7,20 @@ namespace SR
 {
     using BufferAddres = void*;
 
+    enum
+    {
+        SHADER_MAX_VARYING_COMPONENTS = 16,
+        SHADER_QUAD_SIZE = 4,
+    };
+
+    enum VaryingInterpolation
+    {
+        VARYING_INTERPOLATION_PERSPECTIVE   = 0,
+        VARYING_INTERPOLATION_NOPERSPECTIVE = 1,
+        // Constant over the triangle, the value of its first vertex
+        VARYING_INTERPOLATION_FLAT          = 2,
+    };
+
     struct ShaderPayload
     {
         Vector4 clipPosition;
@@ -21,10 +35,72 @@ namespace SR
     struct VertexShader
     {
         void (*Main)(uint32 SV_VertexID, ShaderPayload& output, const void* pushConstants);
+        // Optional, shades the contiguous vertices [firstVertexID, firstVertexID + numVertices)
+        // and applies PerspectiveDivision to the outputs itself, so vector paths can fuse it
+        void (*MainBatch)(uint32 firstVertexID, uint32 numVertices, ShaderPayload* outputs, const void* pushConstants) = nullptr;
+    };
+
+    // Computes 1/w and the NDC position after the vertex shader
+    extern void PerspectiveDivision(ShaderPayload* payload);
+
+    // A pixel shader input: numComponents floats of ShaderPayload starting at byte offset
+    struct Varying
+    {
+        uint32 offset;
+        uint32 numComponents;
+        VaryingInterpolation interpolation;
+        // Stored as 16-bit floats between the vertex and the pixel stage
+        bool halfPrecision;
+    };
+
+    #define SHADER_VARYING(member, interpolation, halfPrecision) \
+        Varying{ (uint32)offsetof(ShaderPayload, member), (uint32)(sizeof(ShaderPayload::member) / sizeof(float)), interpolation, halfPrecision }
+
+    // Varyings read by a pixel shader, the only attributes that are stored and interpolated
+    struct VaryingLayout
+    {
+        uint32 numVaryings;
+        Varying varyings[SHADER_MAX_VARYING_COMPONENTS];
+    };
+
+    // The 2x2 pixels a pixel shader invocation is shaded with, lanes are ordered (x, y), (x + 1, y),
+    // (x, y + 1), (x + 1, y + 1) from the even top-left pixel. Helper lanes are outside the primitive or
+    // failed the depth test, their varyings are interpolated for derivatives but they are not shaded.
+    // Only the varyings declared by the pixel shader are valid.
+    struct PixelQuad
+    {
+        const ShaderPayload* lanes;
+        uint32 laneIndex;
+        uint32 helperMask;
+
+        bool IsHelperLane(uint32 lane) const
+        {
+            return (helperMask >> lane) & 1;
+        }
+
+        // Coarse derivatives, the difference across the top row and the left column, the same for all lanes so
+        // that PixelShader::Main and PixelShader::MainQuad pick the same mip level
+        template <typename T>
+        T DDX(T ShaderPayload::* varying) const
+        {
+            return lanes[1].*varying - lanes[0].*varying;
+        }
+
+        template <typename T>
+        T DDY(T ShaderPayload::* varying) const
+        {
+            return lanes[2].*varying - lanes[0].*varying;
+        }
     };
 
     struct PixelShader
     {
-        Vector4 (*Main)(const ShaderPayload& input, const void* pushConstants);
+        // input is quad.lanes[quad.laneIndex]
+        Vector4 (*Main)(const ShaderPayload& input, const PixelQuad& quad, const void* pushConstants);
+        // nullptr interpolates every attribute of ShaderPayload
+        const VaryingLayout* varyingLayout = nullptr;
+        // Optional, shades the lanes of laneMask at once, so texture samples can be batched with
+        // Texture::SampleGradQuad. The rasterizer uses it instead of Main, visibility buffer resolves use Main.
+        void (*MainQuad)(const PixelQuad& quad, uint32 laneMask, const void* pushConstants, Vector4 outColors[SHADER_QUAD_SIZE]) = nullptr;
     };
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include "SRMath.h"
 #include "Scene.h"
 #include "Texture.h"
+#include "CPUFeatures.h"
+#include "ShaderKernels.h"
 
 #define EPSILON 0.00001f
 
@@ -131,32 +133,92 @@ namespace SR
         return Vector4(linear, sRGB.w);
     }
 
+    // 5x5 texel PCF from 9 comparison taps. Each bilinear SampleCmp covers 2x2 texels, the tap offsets and weights
+    // (Castano, "Shadow Mapping Summary") make their bilinear weights add up to a smooth 5x5 kernel.
     float PCF(RenderTarget<float>* shadowMap, Vector3 shadowMapCoord)
     {
         if ((shadowMapCoord.y < 0.0f) || (shadowMapCoord.y > 1.0f)) return 1.0f;
         if ((shadowMapCoord.x < 0.0f) || (shadowMapCoord.x > 1.0f)) return 1.0f;
         if (shadowMapCoord.z < 0.0f) return 1.0f;
         if (shadowMapCoord.z > 1.0f) return 1.0f;
-        shadowMapCoord.z -= 0.1f;
-
-        uint32 shadowMapSize = shadowMap->GetWidth();
-        float dx = 1.0f / float(shadowMapSize);
-        float dy = 1.0f / float(shadowMapSize);
+        // The shadow map holds depth in [0, 1] of the light projection
+        shadowMapCoord.z -= 0.001f;
+
+        const Vector2 shadowMapSize = Vector2(shadowMap->GetWidth(), shadowMap->GetHeight());
+        const Vector2 texelSize = 1.0f / shadowMapSize;
+        const Vector2 uv = Vector2(shadowMapCoord) * shadowMapSize;
+        Vector2 baseUV = glm::floor(uv + Vector2(0.5f));
+        const Vector2 st = uv + Vector2(0.5f) - baseUV;
+        baseUV = (baseUV - Vector2(0.5f)) * texelSize;
+
+        const Vector2 weights[3] = { Vector2(4.0f) - 3.0f * st, Vector2(7.0f), Vector2(1.0f) + 3.0f * st };
+        const Vector2 offsets[3] = {
+            (Vector2(3.0f) - 2.0f * st) / weights[0] - Vector2(2.0f),
+            (Vector2(3.0f) + st) / weights[1],
+            st / weights[2] + Vector2(2.0f)
+        };
 
         float result = 0.0f;
-        for (int i = -2; i <= 2; i++)
+        for (uint32 j = 0; j < 3; j++)
         {
-            for (int j = -2; j <= 2; j++)
+            for (uint32 i = 0; i < 3; i++)
             {
-                float depth = shadowMap->Sample(SAMPLER_LINEAR_WARP, shadowMapCoord + Vector3(dx * i, dy * j, 0));
-                if (shadowMapCoord.z < depth)
+                const Vector2 tapUV = baseUV + Vector2(offsets[i].x, offsets[j].y) * texelSize;
+                result += weights[i].x * weights[j].y * shadowMap->SampleCmp(SAMPLER_LINEAR_CLAMP, tapUV, shadowMapCoord.z);
+            }
+        }
+        return result / 144.0f;
+    }
+
+    // Fraction of a distribution of depths with these moments that is at or beyond mean. pMax below
+    // lightBleedingReduction is cut to 0, which darkens the light that leaks where occluders overlap.
+    float ChebyshevUpperBound(Vector2 moments, float mean, float minVariance, float lightBleedingReduction)
+    {
+        if (mean <= moments.x) return 1.0f;
+        float variance = std::max(moments.y - moments.x * moments.x, minVariance);
+        float d = mean - moments.x;
+        float pMax = variance / (variance + d * d);
+        return glm::clamp((pMax - lightBleedingReduction) / (1.0f - lightBleedingReduction), 0.0f, 1.0f);
+    }
+
+    // One bilinear sample of the prefiltered moments, tested with both warps
+    float EVSM(const RenderTarget<Vector4>* shadowMoments, Vector3 shadowMapCoord)
+    {
+        if ((shadowMapCoord.y < 0.0f) || (shadowMapCoord.y > 1.0f)) return 1.0f;
+        if ((shadowMapCoord.x < 0.0f) || (shadowMapCoord.x > 1.0f)) return 1.0f;
+        if (shadowMapCoord.z < 0.0f) return 1.0f;
+        if (shadowMapCoord.z > 1.0f) return 1.0f;
+
+        const Vector4 moments = shadowMoments->Sample(SAMPLER_LINEAR_CLAMP, Vector2(shadowMapCoord));
+        const Vector2 warpedDepth = WarpDepthEVSM(shadowMapCoord.z);
+        // Variance of a depth error of 0.0001, scaled by the slope of the warps
+        const Vector2 depthScale = 0.0001f * Vector2(EVSM_POSITIVE_EXPONENT, EVSM_NEGATIVE_EXPONENT) * warpedDepth;
+        const Vector2 minVariance = depthScale * depthScale;
+        const float positive = ChebyshevUpperBound(Vector2(moments.x, moments.y), warpedDepth.x, minVariance.x, 0.3f);
+        const float negative = ChebyshevUpperBound(Vector2(moments.z, moments.w), warpedDepth.y, minVariance.y, 0.3f);
+        return std::min(positive, negative);
+    }
+
+    // From the first cascade whose slice of the camera frustum holds the pixel, unshadowed past the last one
+    float CascadedShadow(const CascadedShadowMap& shadowMap, uint32 shadowType, const Vector3& position, float viewDepth)
+    {
+        for (uint32 cascadeIndex = 0; cascadeIndex < shadowMap.GetNumCascades(); cascadeIndex++)
+        {
+            const ShadowCascade& cascade = shadowMap.GetCascade(cascadeIndex);
+            if (viewDepth <= cascade.splitDistance)
+            {
+                // Orthographic, w is 1
+                Vector3 shadowMapCoord = Vector3(cascade.viewProjection * Vector4(position, 1.0f));
+                shadowMapCoord.x = (1.0f + shadowMapCoord.x) * 0.5f;
+                shadowMapCoord.y = (1.0f + shadowMapCoord.y) * 0.5f;
+                if (shadowType == SHADOW_TYPE_EVSM)
                 {
-                    result++;
+                    return EVSM(shadowMap.GetExponentialVarianceShadowMap(cascadeIndex)->GetMoments(), shadowMapCoord);
                 }
+                return PCF(shadowMap.GetDepth(cascadeIndex), shadowMapCoord);
             }
         }
-        result /= (5 * 5);
-        return result;
+        return 1.0f;
     }
 
     void PBRMainVS(uint32 SV_VertexID, ShaderPayload& output, const void* pushConstants)
@@ -181,34 +243,117 @@ namespace SR
         output.texCoord = texCoord;
     }
 
-    Vector4 PBRMainPS(const ShaderPayload& input, const void* pushConstants)
+    void PBRMainBatchVS(uint32 firstVertexID, uint32 numVertices, ShaderPayload* outputs, const void* pushConstants)
     {
         const PBRShaderPushConstants& pc = *(PBRShaderPushConstants*)pushConstants;
+
+        uint32 numVectorVertices = 0;
+        if (GetCPUFeatures().avx2 && GetCPUFeatures().fma)
+        {
+            numVectorVertices = numVertices - numVertices % SHADER_VERTEX_BATCH_WIDTH;
+            PBRMainBatchVSAVX2(firstVertexID, numVectorVertices, outputs, pc);
+        }
+
+        // Same as PBRMainVS with the per-draw state loaded once per batch
+        const Matrix4x4 worldMatrix = *pc.worldMatrix;
+        const Matrix3x3 normalMatrix = Matrix3x3(worldMatrix);
+        const Matrix4x4 viewProjectionMatrix = ((PerFrameData*)pc.perFrameData)->viewProjectionMatrix;
+        const Vector3* positions = (Vector3*)pc.positions + firstVertexID;
+        const Vector3* normals = (Vector3*)pc.normals + firstVertexID;
+        const Vector3* tangents = (Vector3*)pc.tangents + firstVertexID;
+        const Vector2* texCoords = (Vector2*)pc.texCoords + firstVertexID;
+
+        for (uint32 i = numVectorVertices; i < numVertices; i++)
+        {
+            ShaderPayload& output = outputs[i];
+            Vector4 worldPosition = worldMatrix * Vector4(positions[i], 1.0f);
+            output.clipPosition = viewProjectionMatrix * worldPosition;
+            output.clipPosition.y = -output.clipPosition.y;
+            output.worldPosition = Vector3(worldPosition);
+            output.worldNormal = Math::Normalize(normalMatrix * normals[i]);
+            output.worldTangent = Math::Normalize(normalMatrix * tangents[i]);
+            output.texCoord = texCoords[i];
+            PerspectiveDivision(&output);
+        }
+    }
+
+    const VaryingLayout PBRMainPSVaryingLayout = {
+        5,
+        {
+            // Only z and w, for the depth debug view
+            Varying{ (uint32)(offsetof(ShaderPayload, clipPosition) + 2 * sizeof(float)), 2, VARYING_INTERPOLATION_NOPERSPECTIVE, false },
+            SHADER_VARYING(worldPosition, VARYING_INTERPOLATION_PERSPECTIVE, false),
+            // Directions are normalized per pixel, half precision is enough
+            SHADER_VARYING(worldNormal, VARYING_INTERPOLATION_PERSPECTIVE, true),
+            SHADER_VARYING(worldTangent, VARYING_INTERPOLATION_PERSPECTIVE, true),
+            SHADER_VARYING(texCoord, VARYING_INTERPOLATION_PERSPECTIVE, false),
+        }
+    };
+
+    // Texture samples of one pixel, samples of maps the material does not have are unused
+    struct PBRMaterialSamples
+    {
+        Vector4 baseColor;
+        Vector4 normal;
+        Vector4 metallicRoughness;
+    };
+
+    static Vector4 ShadePBR(const ShaderPayload& input, const PBRShaderPushConstants& pc, const PBRMaterialSamples& samples)
+    {
         const PerFrameData& perFrameData = *(PerFrameData*)pc.perFrameData;
         const PBRMaterial& material = *(PBRMaterial*)pc.material;
 
         Vector3 geometricWorldNormal = glm::normalize(input.worldNormal);
         Vector3 worldTangent = glm::normalize(input.worldTangent);
         Vector3 position = input.worldPosition;
-        Vector2 texCoord0 = input.texCoord;
         float gamma = perFrameData.gamma;
         DebugView debugView = perFrameData.debugView;
 
-        Vector4 baseColor = material.baseColorMap ? material.baseColor * SRGBToLinear(material.baseColorMap->Sample(SAMPLER_LINEAR_WARP, texCoord0), gamma) : material.baseColor;
+        Vector4 baseColor = material.baseColor;
+        if (material.baseColorMap)
+        {
+            // sRGB textures are already decoded to linear by the sampler
+            baseColor *= IsSRGBFormat(material.baseColorMap->GetFormat()) ? samples.baseColor : SRGBToLinear(samples.baseColor, gamma);
+        }
         
         Vector3 N = geometricWorldNormal;
         if (material.normalMap)
         {
-            Vector3 tangentNormal = glm::normalize(Vector3(material.normalMap->Sample(SAMPLER_LINEAR_WARP, texCoord0)) * 2.0f - Vector3(1.0f));
+            Vector3 tangentNormal;
+            TextureFormat normalMapFormat = material.normalMap->GetFormat();
+            if (normalMapFormat == TEXTURE_FORMAT_BC5_UNORM || normalMapFormat == TEXTURE_FORMAT_RG8_UNORM)
+            {
+                // Two channel normal maps only store XY
+                Vector2 xy = Vector2(samples.normal) * 2.0f - Vector2(1.0f);
+                tangentNormal = Vector3(xy, std::sqrt(std::max(0.0f, 1.0f - glm::dot(xy, xy))));
+            }
+            else
+            {
+                tangentNormal = glm::normalize(Vector3(samples.normal) * 2.0f - Vector3(1.0f));
+            }
             Vector3 T = worldTangent;
             Vector3 B = glm::cross(N, T);
             Matrix3x3 TBN = Matrix3x3(T, B, N);
             N = glm::normalize(TBN * tangentNormal);
         }
 
-        Vector4 metallicRoughness = material.metallicRoughnessMap ? material.metallicRoughnessMap->Sample(SAMPLER_LINEAR_WARP, texCoord0) : Vector4(1.0f);
-        float metallic = material.metallic * metallicRoughness.b;
-        float roughness = material.roughness * metallicRoughness.g;
+        float metallic = material.metallic;
+        float roughness = material.roughness;
+        if (material.metallicRoughnessMap)
+        {
+            TextureFormat metallicRoughnessMapFormat = material.metallicRoughnessMap->GetFormat();
+            if (metallicRoughnessMapFormat == TEXTURE_FORMAT_BC5_UNORM || metallicRoughnessMapFormat == TEXTURE_FORMAT_RG8_UNORM)
+            {
+                // Two channel metallic-roughness maps only store roughness and metallic, moved from GB to RG
+                metallic *= samples.metallicRoughness.g;
+                roughness *= samples.metallicRoughness.r;
+            }
+            else
+            {
+                metallic *= samples.metallicRoughness.b;
+                roughness *= samples.metallicRoughness.g;
+            }
+        }
 
         float depth01 = input.clipPosition.z / input.clipPosition.w;
 
@@ -222,11 +367,8 @@ namespace SR
         float visibility = 1.0f;
         if (pc.shadowMap && !pc.renderShadow)
         {
-            Vector4 shadowMapCoord = *pc.lightMatrix * Vector4(position, 1.0f);
-            shadowMapCoord /= shadowMapCoord.w;
-            shadowMapCoord.x = (1.0f + shadowMapCoord.x) * 0.5f;
-            shadowMapCoord.y = (1.0f + shadowMapCoord.y) * 0.5f;
-            visibility = PCF(pc.shadowMap, Vector3(shadowMapCoord));
+            const float viewDepth = -(perFrameData.viewMatrix * Vector4(position, 1.0f)).z;
+            visibility = CascadedShadow(*pc.shadowMap, pc.shadowType, position, viewDepth);
         }
 
         // Direct Lighting
@@ -282,4 +424,74 @@ namespace SR
         }
         return color;
     }
+
+    Vector4 PBRMainPS(const ShaderPayload& input, const PixelQuad& quad, const void* pushConstants)
+    {
+        const PBRShaderPushConstants& pc = *(PBRShaderPushConstants*)pushConstants;
+        const PBRMaterial& material = *(PBRMaterial*)pc.material;
+        const Vector2 texCoord0DDX = quad.DDX(&ShaderPayload::texCoord);
+        const Vector2 texCoord0DDY = quad.DDY(&ShaderPayload::texCoord);
+
+        PBRMaterialSamples samples;
+        if (material.baseColorMap)
+        {
+            samples.baseColor = material.baseColorMap->SampleGrad(SAMPLER_TRILINEAR_WARP, input.texCoord, texCoord0DDX, texCoord0DDY);
+        }
+        if (material.normalMap)
+        {
+            samples.normal = material.normalMap->SampleGrad(SAMPLER_TRILINEAR_WARP, input.texCoord, texCoord0DDX, texCoord0DDY);
+        }
+        if (material.metallicRoughnessMap)
+        {
+            samples.metallicRoughness = material.metallicRoughnessMap->SampleGrad(SAMPLER_TRILINEAR_WARP, input.texCoord, texCoord0DDX, texCoord0DDY);
+        }
+        return ShadePBR(input, pc, samples);
+    }
+
+    void PBRMainQuadPS(const PixelQuad& quad, uint32 laneMask, const void* pushConstants, Vector4 outColors[SHADER_QUAD_SIZE])
+    {
+        const PBRShaderPushConstants& pc = *(PBRShaderPushConstants*)pushConstants;
+        const PBRMaterial& material = *(PBRMaterial*)pc.material;
+        Vector2 texCoord0[SHADER_QUAD_SIZE];
+        for (uint32 lane = 0; lane < SHADER_QUAD_SIZE; lane++)
+        {
+            texCoord0[lane] = quad.lanes[lane].texCoord;
+        }
+        // Coarse derivatives of the quad, all lanes sample the same LOD
+        const Vector2 texCoord0DDX = quad.DDX(&ShaderPayload::texCoord);
+        const Vector2 texCoord0DDY = quad.DDY(&ShaderPayload::texCoord);
+
+        PBRMaterialSamples samples[SHADER_QUAD_SIZE];
+        Vector4 texels[SHADER_QUAD_SIZE];
+        if (material.baseColorMap)
+        {
+            material.baseColorMap->SampleGradQuad(SAMPLER_TRILINEAR_WARP, texCoord0, texCoord0DDX, texCoord0DDY, texels);
+            for (uint32 lane = 0; lane < SHADER_QUAD_SIZE; lane++)
+            {
+                samples[lane].baseColor = texels[lane];
+            }
+        }
+        if (material.normalMap)
+        {
+            material.normalMap->SampleGradQuad(SAMPLER_TRILINEAR_WARP, texCoord0, texCoord0DDX, texCoord0DDY, texels);
+            for (uint32 lane = 0; lane < SHADER_QUAD_SIZE; lane++)
+            {
+                samples[lane].normal = texels[lane];
+            }
+        }
+        if (material.metallicRoughnessMap)
+        {
+            material.metallicRoughnessMap->SampleGradQuad(SAMPLER_TRILINEAR_WARP, texCoord0, texCoord0DDX, texCoord0DDY, texels);
+            for (uint32 lane = 0; lane < SHADER_QUAD_SIZE; lane++)
+            {
+                samples[lane].metallicRoughness = texels[lane];
+            }
+        }
+
+        for (uint32 lanes = laneMask; lanes != 0; lanes &= lanes - 1)
+        {
+            const uint32 lane = (uint32)Math::CountTrailingZeros(lanes);
+            outColors[lane] = ShadePBR(quad.lanes[lane], pc, samples[lane]);
+        }
+    }
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "Shaders/ShaderCommon.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "Shadows.h"
 
 namespace SR
 {
@@ -16,12 +17,14 @@ namespace SR
         BufferAddres perFrameData;
         BufferAddres material;
         Matrix4x4* worldMatrix;
-        Matrix4x4* lightMatrix;
         uint32 shadowType;
         bool renderShadow;
-        RenderTarget<float>* shadowMap;
+        const CascadedShadowMap* shadowMap;
     };
 
     extern void PBRMainVS(uint32 SV_VertexID, ShaderPayload& output, const void* pushConstants);
-    extern Vector4 PBRMainPS(const ShaderPayload& input, const void* pushConstants);
+    extern void PBRMainBatchVS(uint32 firstVertexID, uint32 numVertices, ShaderPayload* outputs, const void* pushConstants);
+    extern Vector4 PBRMainPS(const ShaderPayload& input, const PixelQuad& quad, const void* pushConstants);
+    extern void PBRMainQuadPS(const PixelQuad& quad, uint32 laneMask, const void* pushConstants, Vector4 outColors[SHADER_QUAD_SIZE]);
+    extern const VaryingLayout PBRMainPSVaryingLayout;
 }
\ No newline at end of file
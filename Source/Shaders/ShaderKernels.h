@@ -0,0 +1,19 @@
+#pragma once
+
+#include "SRCommon.h"
+#include "Shader.h"
+#include "Shaders/PBRShader.h"
+#include "Shaders/ShadowMapShader.h"
+
+namespace SR
+{
+    enum
+    {
+        SHADER_VERTEX_BATCH_WIDTH = 8,
+    };
+
+    // Vectorized vertex shaders, vertices are loaded and transformed SHADER_VERTEX_BATCH_WIDTH at a time
+    // in SoA form. numVertices must be a multiple of SHADER_VERTEX_BATCH_WIDTH, outputs are perspective divided.
+    extern void PBRMainBatchVSAVX2(uint32 firstVertexID, uint32 numVertices, ShaderPayload* outputs, const PBRShaderPushConstants& pc);
+    extern void ShaderMapShaderMainBatchVSAVX2(uint32 firstVertexID, uint32 numVertices, ShaderPayload* outputs, const SMShaderPushConstants& pc);
+}
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "Shaders/ShaderKernels.h"
+#include "Shaders/ShaderCommon.h"
+
+#include <immintrin.h>
+
+// This translation unit is built with AVX2 code generation and must only be entered after a CPU check.
+// No glm function is called here: the compiler may keep this unit's AVX2 copy of an inline function for
+// the whole program, so matrices, vectors and payloads are accessed as floats.
+namespace SR
+{
+    // Matrix with every element broadcast, m[column][row] like glm
+    struct MatrixAVX2
+    {
+        __m256 m[4][4];
+    };
+
+    // Post-transform outputs of SHADER_VERTEX_BATCH_WIDTH vertices, one register per component
+    struct PostTransformVerticesAVX2
+    {
+        __m256 clipPosition[4];
+        __m256 ndcPosition[3];
+        __m256 worldPosition[3];
+        __m256 worldNormal[3];
+        __m256 worldTangent[3];
+        __m256 invW;
+    };
+
+    // matrix points to the 16 floats of a Matrix4x4, column-major
+    static MatrixAVX2 BroadcastMatrix(const float* matrix)
+    {
+        MatrixAVX2 result;
+        for (uint32 column = 0; column < 4; column++)
+        {
+            for (uint32 row = 0; row < 4; row++)
+            {
+                result.m[column][row] = _mm256_set1_ps(matrix[column * 4 + row]);
+            }
+        }
+        return result;
+    }
+
+    // Deinterleaves 8 consecutive Vector3
+    FORCEINLINE static void LoadVector3SoA(const float* base, __m256 out[3])
+    {
+        const __m256i offsets = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+        out[0] = _mm256_i32gather_ps(base + 0, offsets, 4);
+        out[1] = _mm256_i32gather_ps(base + 1, offsets, 4);
+        out[2] = _mm256_i32gather_ps(base + 2, offsets, 4);
+    }
+
+    // M * (v, w) for the first numRows rows
+    FORCEINLINE static void Transform(const MatrixAVX2& matrix, const __m256 v[3], const __m256& w, uint32 numRows, __m256* out)
+    {
+        for (uint32 row = 0; row < numRows; row++)
+        {
+            __m256 result = _mm256_mul_ps(matrix.m[3][row], w);
+            result = _mm256_fmadd_ps(matrix.m[2][row], v[2], result);
+            result = _mm256_fmadd_ps(matrix.m[1][row], v[1], result);
+            out[row] = _mm256_fmadd_ps(matrix.m[0][row], v[0], result);
+        }
+    }
+
+    FORCEINLINE static void Normalize(__m256 v[3])
+    {
+        __m256 lengthSquared = _mm256_mul_ps(v[0], v[0]);
+        lengthSquared = _mm256_fmadd_ps(v[1], v[1], lengthSquared);
+        lengthSquared = _mm256_fmadd_ps(v[2], v[2], lengthSquared);
+        const __m256 invLength = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(lengthSquared));
+        v[0] = _mm256_mul_ps(v[0], invLength);
+        v[1] = _mm256_mul_ps(v[1], invLength);
+        v[2] = _mm256_mul_ps(v[2], invLength);
+    }
+
+    FORCEINLINE static void PerspectiveDivision(PostTransformVerticesAVX2& vertices)
+    {
+        vertices.invW = _mm256_div_ps(_mm256_set1_ps(1.0f), vertices.clipPosition[3]);
+        for (uint32 i = 0; i < 3; i++)
+        {
+            vertices.ndcPosition[i] = _mm256_mul_ps(vertices.clipPosition[i], vertices.invW);
+        }
+    }
+
+    // The float at componentIndex of the payload member at memberOffset
+    FORCEINLINE static float* GetPayloadComponent(ShaderPayload* payload, size_t memberOffset, uint32 componentIndex)
+    {
+        return (float*)((uint8*)payload + memberOffset) + componentIndex;
+    }
+
+    FORCEINLINE static void StoreComponent(const __m256& value, float* outPayloadComponent)
+    {
+        alignas(32) float lanes[SHADER_VERTEX_BATCH_WIDTH];
+        _mm256_store_ps(lanes, value);
+        for (uint32 lane = 0; lane < SHADER_VERTEX_BATCH_WIDTH; lane++)
+        {
+            *(float*)((uint8*)outPayloadComponent + lane * sizeof(ShaderPayload)) = lanes[lane];
+        }
+    }
+
+    void PBRMainBatchVSAVX2(uint32 firstVertexID, uint32 numVertices, ShaderPayload* outputs, const PBRShaderPushConstants& pc)
+    {
+        ASSERT(numVertices % SHADER_VERTEX_BATCH_WIDTH == 0);
+
+        const MatrixAVX2 worldMatrix = BroadcastMatrix((const float*)pc.worldMatrix);
+        const MatrixAVX2 viewProjectionMatrix = BroadcastMatrix((const float*)&((PerFrameData*)pc.perFrameData)->viewProjectionMatrix);
+        const float* positions = (const float*)pc.positions + firstVertexID * 3;
+        const float* normals = (const float*)pc.normals + firstVertexID * 3;
+        const float* tangents = (const float*)pc.tangents + firstVertexID * 3;
+        const float* texCoords = (const float*)pc.texCoords + firstVertexID * 2;
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 zero = _mm256_setzero_ps();
+
+        for (uint32 first = 0; first < numVertices; first += SHADER_VERTEX_BATCH_WIDTH)
+        {
+            PostTransformVerticesAVX2 vertices;
+
+            __m256 v[3];
+            __m256 worldPosition[4];
+            LoadVector3SoA(positions + first * 3, v);
+            Transform(worldMatrix, v, one, 4, worldPosition);
+            Transform(viewProjectionMatrix, worldPosition, worldPosition[3], 4, vertices.clipPosition);
+            vertices.clipPosition[1] = _mm256_sub_ps(zero, vertices.clipPosition[1]);
+            vertices.worldPosition[0] = worldPosition[0];
+            vertices.worldPosition[1] = worldPosition[1];
+            vertices.worldPosition[2] = worldPosition[2];
+
+            LoadVector3SoA(normals + first * 3, v);
+            Transform(worldMatrix, v, zero, 3, vertices.worldNormal);
+            Normalize(vertices.worldNormal);
+
+            LoadVector3SoA(tangents + first * 3, v);
+            Transform(worldMatrix, v, zero, 3, vertices.worldTangent);
+            Normalize(vertices.worldTangent);
+
+            PerspectiveDivision(vertices);
+
+            ShaderPayload* output = outputs + first;
+            for (uint32 i = 0; i < 4; i++)
+            {
+                StoreComponent(vertices.clipPosition[i], GetPayloadComponent(output, offsetof(ShaderPayload, clipPosition), i));
+            }
+            for (uint32 i = 0; i < 3; i++)
+            {
+                StoreComponent(vertices.ndcPosition[i], GetPayloadComponent(output, offsetof(ShaderPayload, ndcPosition), i));
+                StoreComponent(vertices.worldPosition[i], GetPayloadComponent(output, offsetof(ShaderPayload, worldPosition), i));
+                StoreComponent(vertices.worldNormal[i], GetPayloadComponent(output, offsetof(ShaderPayload, worldNormal), i));
+                StoreComponent(vertices.worldTangent[i], GetPayloadComponent(output, offsetof(ShaderPayload, worldTangent), i));
+            }
+            StoreComponent(vertices.invW, GetPayloadComponent(output, offsetof(ShaderPayload, invW), 0));
+            for (uint32 lane = 0; lane < SHADER_VERTEX_BATCH_WIDTH; lane++)
+            {
+                memcpy(GetPayloadComponent(output + lane, offsetof(ShaderPayload, texCoord), 0), texCoords + (first + lane) * 2, 2 * sizeof(float));
+            }
+        }
+    }
+
+    void ShaderMapShaderMainBatchVSAVX2(uint32 firstVertexID, uint32 numVertices, ShaderPayload* outputs, const SMShaderPushConstants& pc)
+    {
+        ASSERT(numVertices % SHADER_VERTEX_BATCH_WIDTH == 0);
+
+        const MatrixAVX2 mvp = BroadcastMatrix((const float*)&pc.mvp);
+        const float* vertices = (const float*)pc.vertices + firstVertexID * 3;
+        const __m256 one = _mm256_set1_ps(1.0f);
+
+        for (uint32 first = 0; first < numVertices; first += SHADER_VERTEX_BATCH_WIDTH)
+        {
+            __m256 position[3];
+            __m256 clipPosition[4];
+            LoadVector3SoA(vertices + first * 3, position);
+            Transform(mvp, position, one, 4, clipPosition);
+            const __m256 invW = _mm256_div_ps(one, clipPosition[3]);
+
+            ShaderPayload* output = outputs + first;
+            for (uint32 i = 0; i < 4; i++)
+            {
+                StoreComponent(clipPosition[i], GetPayloadComponent(output, offsetof(ShaderPayload, clipPosition), i));
+            }
+            for (uint32 i = 0; i < 3; i++)
+            {
+                StoreComponent(_mm256_mul_ps(clipPosition[i], invW), GetPayloadComponent(output, offsetof(ShaderPayload, ndcPosition), i));
+            }
+            StoreComponent(invW, GetPayloadComponent(output, offsetof(ShaderPayload, invW), 0));
+        }
+    }
+}
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include "SRMath.h"
 #include "Scene.h"
 #include "Texture.h"
+#include "CPUFeatures.h"
+#include "ShaderKernels.h"
 
 namespace SR
 {
@@ -9,12 +11,27 @@ namespace SR
 	{
 		const SMShaderPushConstants& pc = *(SMShaderPushConstants*)pushConstants;
 
-		Vector4 localPosition = Vector4(((Vector3*)pc.vertices)[SV_VertexID], 1.0f);
+		Vector4 localPosition = Vector4(((const Vector3*)pc.vertices)[SV_VertexID], 1.0f);
 		output.clipPosition = pc.mvp * localPosition;
 	}
 
-	Vector4 ShaderMapShaderMainPS(const ShaderPayload& input, const void* pushConstants)
+	void ShaderMapShaderMainBatchVS(uint32 firstVertexID, uint32 numVertices, ShaderPayload* outputs, const void* pushConstants)
 	{
-		return Vector4(1.0f);
+		const SMShaderPushConstants& pc = *(SMShaderPushConstants*)pushConstants;
+
+		uint32 numVectorVertices = 0;
+		if (GetCPUFeatures().avx2 && GetCPUFeatures().fma)
+		{
+			numVectorVertices = numVertices - numVertices % SHADER_VERTEX_BATCH_WIDTH;
+			ShaderMapShaderMainBatchVSAVX2(firstVertexID, numVectorVertices, outputs, pc);
+		}
+
+		const Matrix4x4 mvp = pc.mvp;
+		const Vector3* vertices = (const Vector3*)pc.vertices + firstVertexID;
+		for (uint32 i = numVectorVertices; i < numVertices; i++)
+		{
+			outputs[i].clipPosition = mvp * Vector4(vertices[i], 1.0f);
+			PerspectiveDivision(&outputs[i]);
+		}
 	}
 }
\ No newline at end of file
@@ -8,9 +8,10 @@ namespace SR
 	struct SMShaderPushConstants
 	{
 		Matrix4x4 mvp; 
-		BufferAddres vertices;
+		const void* vertices;
 	};
 
+	// Rendered with a depth-only pipeline, there is no pixel shader
 	extern void ShaderMapShaderMainVS(uint32 SV_VertexID, ShaderPayload& output, const void* pushConstants);
-	extern Vector4 ShaderMapShaderMainPS(const ShaderPayload& input, const void* pushConstants);
+	extern void ShaderMapShaderMainBatchVS(uint32 firstVertexID, uint32 numVertices, ShaderPayload* outputs, const void* pushConstants);
 }
\ No newline at end of file
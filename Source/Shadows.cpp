@@ -0,0 +1,349 @@
+#include "Shadows.h"
+#include "JobSystem.h"
+
+namespace SR
+{
+    enum
+    {
+        SHADOW_FILTER_ROWS_PER_JOB = 16,
+        SHADOW_COPY_ROWS_PER_JOB = 64,
+    };
+
+    // Blend of logarithmic and uniform cascade splits, logarithmic ones alone leave the far cascades too large
+    #define SHADOW_CASCADE_SPLIT_LAMBDA 0.75f
+
+    struct ShadowFilterJobData
+    {
+        const RenderTarget<float>* shadowMap;
+        RenderTarget<Vector4>* rowMoments;
+        RenderTarget<Vector4>* moments;
+        uint32 firstRow;
+        uint32 numRows;
+        uint32 blurRadius;
+    };
+
+    struct ShadowCopyJobData
+    {
+        const RenderTarget<float>* source;
+        RenderTarget<float>* destination;
+        uint32 firstRow;
+        uint32 numRows;
+        int32 offsetX;
+        int32 offsetY;
+    };
+
+    // Warps the depths of the rows and blurs the moments horizontally
+    static void ExecuteShadowFilterRows(ShadowFilterJobData* data)
+    {
+        const int width = (int)data->shadowMap->GetWidth();
+        const int radius = (int)data->blurRadius;
+        const float weight = 1.0f / (float)(2 * radius + 1);
+        // The moments of a row, with radius texels of the edges repeated at both ends
+        std::vector<Vector4> row(width + 2 * radius);
+        for (uint32 y = data->firstRow; y < data->firstRow + data->numRows; y++)
+        {
+            // Runs of the same depth, as the cleared texels, are warped once
+            float depth = -1.0f;
+            Vector4 moments;
+            for (int i = 0; i < (int)row.size(); i++)
+            {
+                const int x = glm::clamp(i - radius, 0, width - 1);
+                const float texelDepth = data->shadowMap->Load(x, y);
+                if (texelDepth != depth)
+                {
+                    depth = texelDepth;
+                    const Vector2 warpedDepth = WarpDepthEVSM(depth);
+                    moments = Vector4(warpedDepth.x, warpedDepth.x * warpedDepth.x, warpedDepth.y, warpedDepth.y * warpedDepth.y);
+                }
+                row[i] = moments;
+            }
+            // Summed directly, a running sum would lose the small moments next to e^40
+            for (int x = 0; x < width; x++)
+            {
+                Vector4 sum = Vector4(0.0f);
+                for (int i = 0; i <= 2 * radius; i++)
+                {
+                    sum += row[x + i];
+                }
+                data->rowMoments->Store(x, y, sum * weight);
+            }
+        }
+    }
+
+    // Blurs the moments vertically, a row at a time so the taps are read along rows
+    static void ExecuteShadowFilterColumns(ShadowFilterJobData* data)
+    {
+        const int width = (int)data->rowMoments->GetWidth();
+        const int maxY = (int)data->rowMoments->GetHeight() - 1;
+        const int radius = (int)data->blurRadius;
+        const float weight = 1.0f / (float)(2 * radius + 1);
+        for (uint32 y = data->firstRow; y < data->firstRow + data->numRows; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                Vector4 sum = Vector4(0.0f);
+                for (int i = -radius; i <= radius; i++)
+                {
+                    sum += data->rowMoments->Load(x, glm::clamp((int)y + i, 0, maxY));
+                }
+                data->moments->Store(x, y, sum * weight);
+            }
+        }
+    }
+
+    static void ExecuteShadowCopy(ShadowCopyJobData* data)
+    {
+        data->destination->CopyRows(*data->source, data->firstRow, data->numRows, data->offsetX, data->offsetY, FLT_MAX);
+    }
+
+    void ExponentialVarianceShadowMap::Filter(const RenderTarget<float>& shadowMap, uint32 blurRadius)
+    {
+        const uint32 height = rowMoments.GetHeight();
+        ASSERT(shadowMap.GetWidth() == rowMoments.GetWidth() && shadowMap.GetHeight() == height);
+
+        const uint32 numJobs = (height + SHADOW_FILTER_ROWS_PER_JOB - 1) / SHADOW_FILTER_ROWS_PER_JOB;
+        std::vector<ShadowFilterJobData> jobData(numJobs);
+        std::vector<JobDecl> jobDecls(numJobs);
+        for (uint32 jobIndex = 0; jobIndex < numJobs; jobIndex++)
+        {
+            const uint32 firstRow = jobIndex * SHADOW_FILTER_ROWS_PER_JOB;
+            jobData[jobIndex] = {
+                &shadowMap,
+                &rowMoments,
+                &moments,
+                firstRow,
+                std::min((uint32)SHADOW_FILTER_ROWS_PER_JOB, height - firstRow),
+                blurRadius
+            };
+        }
+
+        // The columns read the rows of the neighboring jobs, so all rows are done first
+        for (uint32 jobIndex = 0; jobIndex < numJobs; jobIndex++)
+        {
+            jobDecls[jobIndex] = {
+                JOB_SYSTEM_JOB_ENTRY_POINT(ExecuteShadowFilterRows),
+                &jobData[jobIndex]
+            };
+        }
+        JobSystemAtomicCounterHandle rowJobCounter = JobSystem::RunJobs(jobDecls.data(), numJobs);
+        JobSystem::WaitForCounterAndFreeWithoutFiber(rowJobCounter);
+
+        for (uint32 jobIndex = 0; jobIndex < numJobs; jobIndex++)
+        {
+            jobDecls[jobIndex] = {
+                JOB_SYSTEM_JOB_ENTRY_POINT(ExecuteShadowFilterColumns),
+                &jobData[jobIndex]
+            };
+        }
+        JobSystemAtomicCounterHandle columnJobCounter = JobSystem::RunJobs(jobDecls.data(), numJobs);
+        JobSystem::WaitForCounterAndFreeWithoutFiber(columnJobCounter);
+    }
+
+    CascadedShadowMap::CascadedShadowMap(uint32 n, uint32 cascadeSize)
+        : size(cascadeSize)
+        , lightView(1.0f)
+    {
+        SetNumCascades(n);
+        for (uint32 i = 0; i < SHADOW_MAX_CASCADES; i++)
+        {
+            cascades[i] = { Matrix4x4(1.0f), 0.0f };
+            placements[i] = { 0, 0, 0.0f, 0.0f, 0.0f };
+            depths[i] = new RenderTarget<float>(size, size);
+            depths[i]->Resize(size, size);
+            staticDepths[i] = new RenderTarget<float>(size, size);
+            staticDepths[i]->Resize(size, size);
+            staticLayerPlacements[i] = placements[i];
+            staticLayerValid[i] = false;
+            dynamicLayerUsed[i] = false;
+            momentsValid[i] = false;
+            momentsBlurRadius[i] = 0;
+            exponentialVarianceShadowMaps[i] = new ExponentialVarianceShadowMap(size, size);
+        }
+    }
+
+    CascadedShadowMap::~CascadedShadowMap()
+    {
+        for (uint32 i = 0; i < SHADOW_MAX_CASCADES; i++)
+        {
+            delete depths[i];
+            delete staticDepths[i];
+            delete exponentialVarianceShadowMaps[i];
+        }
+    }
+
+    void CascadedShadowMap::Update(const Vector3& lightDirection, const Camera& camera, const Matrix4x4& viewMatrix, const BoundingBox& staticBounds)
+    {
+        // Nothing is shadowed farther away than the static scene is wide
+        const float sceneSize = glm::length(staticBounds.max - staticBounds.min);
+        const float nearDistance = camera.zNear;
+        const float farDistance = std::max(std::min(camera.zFar, sceneSize), nearDistance * 2.0f);
+
+        // Fixed at the origin, so that snapping in light space is the same from frame to frame
+        const Vector3 direction = glm::normalize(lightDirection);
+        const Vector3 up = std::abs(direction.y) > 0.99f ? Vector3(0.0f, 0.0f, 1.0f) : Vector3(0.0f, 1.0f, 0.0f);
+        const Matrix4x4 newLightView = glm::lookAt(Vector3(0.0f), direction, up);
+        if (newLightView != lightView)
+        {
+            lightView = newLightView;
+            InvalidateStaticLayers();
+        }
+
+        // The light looks down -z
+        const BoundingBox lightStaticBounds = staticBounds.Transform(lightView);
+        const float zNear = -lightStaticBounds.max.z - sceneSize;
+        const float zFar = -lightStaticBounds.min.z;
+
+        const Matrix4x4 invViewMatrix = Math::Inverse(viewMatrix);
+        const float tanHalfFovY = std::tan(Math::DegreesToRadians(camera.fieldOfView) * 0.5f);
+        const float tanHalfFovX = tanHalfFovY * camera.aspectRatio;
+        float splitNear = nearDistance;
+        for (uint32 cascadeIndex = 0; cascadeIndex < numCascades; cascadeIndex++)
+        {
+            const float t = (float)(cascadeIndex + 1) / (float)numCascades;
+            const float logSplit = nearDistance * std::pow(farDistance / nearDistance, t);
+            const float uniformSplit = nearDistance + (farDistance - nearDistance) * t;
+            const float splitFar = Math::Lerp(uniformSplit, logSplit, SHADOW_CASCADE_SPLIT_LAMBDA);
+
+            Vector3 corners[8];
+            Vector3 center = Vector3(0.0f);
+            for (uint32 i = 0; i < 8; i++)
+            {
+                const float d = (i & 4) ? splitFar : splitNear;
+                const Vector3 viewCorner = Vector3((i & 1) ? d * tanHalfFovX : -d * tanHalfFovX, (i & 2) ? d * tanHalfFovY : -d * tanHalfFovY, -d);
+                corners[i] = Vector3(invViewMatrix * Vector4(viewCorner, 1.0f));
+                center += corners[i] * 0.125f;
+            }
+            float radius = 0.0f;
+            for (uint32 i = 0; i < 8; i++)
+            {
+                radius = std::max(radius, glm::length(corners[i] - center));
+            }
+            // Rounded up so the float error of the corners does not change the texel size
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            const float texelSize = 2.0f * radius / (float)size;
+            const Vector3 lightCenter = Vector3(lightView * Vector4(center, 1.0f));
+            const ShadowPlacement placement = {
+                (int32)std::floor(lightCenter.x / texelSize) - (int32)size / 2,
+                (int32)std::floor(lightCenter.y / texelSize) - (int32)size / 2,
+                texelSize,
+                zNear,
+                zFar
+            };
+            placements[cascadeIndex] = placement;
+            cascades[cascadeIndex] = { GetViewProjection(placement, 0, 0, size, size), splitFar };
+            dynamicLayerUsed[cascadeIndex] = false;
+            splitNear = splitFar;
+        }
+    }
+
+    Matrix4x4 CascadedShadowMap::GetViewProjection(const ShadowPlacement& placement, uint32 x, uint32 y, uint32 width, uint32 height) const
+    {
+        const float left = (float)(placement.originX + (int32)x) * placement.texelSize;
+        const float right = (float)(placement.originX + (int32)(x + width)) * placement.texelSize;
+        const float bottom = (float)(placement.originY + (int32)y) * placement.texelSize;
+        const float top = (float)(placement.originY + (int32)(y + height)) * placement.texelSize;
+        return glm::ortho(left, right, bottom, top, placement.zNear, placement.zFar) * lightView;
+    }
+
+    void CascadedShadowMap::CopyLayer(const RenderTarget<float>* source, RenderTarget<float>* destination, int32 offsetX, int32 offsetY) const
+    {
+        const uint32 numJobs = (size + SHADOW_COPY_ROWS_PER_JOB - 1) / SHADOW_COPY_ROWS_PER_JOB;
+        std::vector<ShadowCopyJobData> jobData(numJobs);
+        std::vector<JobDecl> jobDecls(numJobs);
+        for (uint32 jobIndex = 0; jobIndex < numJobs; jobIndex++)
+        {
+            const uint32 firstRow = jobIndex * SHADOW_COPY_ROWS_PER_JOB;
+            jobData[jobIndex] = {
+                source,
+                destination,
+                firstRow,
+                std::min((uint32)SHADOW_COPY_ROWS_PER_JOB, size - firstRow),
+                offsetX,
+                offsetY
+            };
+            jobDecls[jobIndex] = {
+                JOB_SYSTEM_JOB_ENTRY_POINT(ExecuteShadowCopy),
+                &jobData[jobIndex]
+            };
+        }
+        JobSystemAtomicCounterHandle jobCounter = JobSystem::RunJobs(jobDecls.data(), numJobs);
+        JobSystem::WaitForCounterAndFreeWithoutFiber(jobCounter);
+    }
+
+    uint32 CascadedShadowMap::UpdateStaticLayer(uint32 cascadeIndex, ShadowRegion outRegions[2])
+    {
+        const ShadowPlacement& placement = placements[cascadeIndex];
+        ShadowPlacement& layerPlacement = staticLayerPlacements[cascadeIndex];
+        const int32 offsetX = placement.originX - layerPlacement.originX;
+        const int32 offsetY = placement.originY - layerPlacement.originY;
+        const uint32 numColumns = (uint32)std::abs(offsetX);
+        const uint32 numRows = (uint32)std::abs(offsetY);
+        const bool isLayerReusable = staticLayerValid[cascadeIndex] &&
+            placement.texelSize == layerPlacement.texelSize &&
+            placement.zNear == layerPlacement.zNear && placement.zFar == layerPlacement.zFar &&
+            numColumns < size && numRows < size;
+
+        uint32 numRegions = 0;
+        if (!isLayerReusable)
+        {
+            staticDepths[cascadeIndex]->Clear(FLT_MAX);
+            outRegions[numRegions++] = { 0, 0, size, size, cascades[cascadeIndex].viewProjection };
+        }
+        else if (numColumns > 0 || numRows > 0)
+        {
+            // Shifted into the dynamic layer, which is only copied from the static one later on, and swapped with it
+            CopyLayer(staticDepths[cascadeIndex], depths[cascadeIndex], offsetX, offsetY);
+            std::swap(staticDepths[cascadeIndex], depths[cascadeIndex]);
+
+            // The uncovered columns on one side, then the uncovered rows at the top or bottom of the other columns
+            if (numColumns > 0)
+            {
+                const uint32 x = offsetX > 0 ? size - numColumns : 0;
+                outRegions[numRegions++] = { x, 0, numColumns, size, GetViewProjection(placement, x, 0, numColumns, size) };
+            }
+            if (numRows > 0)
+            {
+                const uint32 x = offsetX < 0 ? numColumns : 0;
+                const uint32 y = offsetY > 0 ? size - numRows : 0;
+                outRegions[numRegions++] = { x, y, size - numColumns, numRows, GetViewProjection(placement, x, y, size - numColumns, numRows) };
+            }
+        }
+        layerPlacement = placement;
+        staticLayerValid[cascadeIndex] = true;
+        if (numRegions > 0)
+        {
+            momentsValid[cascadeIndex] = false;
+        }
+        return numRegions;
+    }
+
+    RenderTarget<float>* CascadedShadowMap::BeginDynamicLayer(uint32 cascadeIndex)
+    {
+        CopyLayer(staticDepths[cascadeIndex], depths[cascadeIndex], 0, 0);
+        dynamicLayerUsed[cascadeIndex] = true;
+        momentsValid[cascadeIndex] = false;
+        return depths[cascadeIndex];
+    }
+
+    void CascadedShadowMap::FilterMoments(uint32 cascadeIndex, uint32 blurRadius)
+    {
+        if (momentsValid[cascadeIndex] && momentsBlurRadius[cascadeIndex] == blurRadius)
+        {
+            return;
+        }
+        exponentialVarianceShadowMaps[cascadeIndex]->Filter(*GetDepth(cascadeIndex), blurRadius);
+        // With dynamic casters in them, the moments only hold for this frame
+        momentsValid[cascadeIndex] = !dynamicLayerUsed[cascadeIndex];
+        momentsBlurRadius[cascadeIndex] = blurRadius;
+    }
+
+    bool CascadedShadowMap::IsCulled(const Matrix4x4& viewProjection, const BoundingBox& worldBounds)
+    {
+        // Clip space of an orthographic projection is the box [-1, 1] x [-1, 1] x [0, 1]
+        const BoundingBox clipBounds = worldBounds.Transform(viewProjection);
+        return clipBounds.max.x < -1.0f || clipBounds.min.x > 1.0f ||
+               clipBounds.max.y < -1.0f || clipBounds.min.y > 1.0f ||
+               clipBounds.max.z < 0.0f || clipBounds.min.z > 1.0f;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "SRCommon.h"
+#include "SRMath.h"
+#include "Texture.h"
+#include "Scene.h"
+
+// Exponents of the EVSM warp. The second moment of a [-1, 1] depth reaches e^(2 * 40), headroom below the
+// overflow of a float at e^(2 * 44).
+#define EVSM_POSITIVE_EXPONENT 40.0f
+#define EVSM_NEGATIVE_EXPONENT 5.0f
+
+namespace SR
+{
+    enum
+    {
+        SHADOW_MIN_CASCADES = 2,
+        SHADOW_MAX_CASCADES = 4,
+    };
+
+    // Positive and negative EVSM warp of a [0, 1] depth, remapped to [-1, 1] first
+    FORCEINLINE Vector2 WarpDepthEVSM(float depth)
+    {
+        depth = 2.0f * glm::clamp(depth, 0.0f, 1.0f) - 1.0f;
+        return Vector2(std::exp(EVSM_POSITIVE_EXPONENT * depth), -std::exp(-EVSM_NEGATIVE_EXPONENT * depth));
+    }
+
+    // Prefiltered moments (p, p^2, n, n^2) of the warped depths p and n of a shadow map. Unlike depths, moments
+    // can be filtered before the lookup, so a lookup is a single bilinear sample whatever the filter width.
+    class ExponentialVarianceShadowMap
+    {
+    public:
+        ExponentialVarianceShadowMap(uint32 w, uint32 h)
+            : rowMoments(w, h)
+            , moments(w, h)
+        {
+            Resize(w, h);
+        }
+        void Resize(uint32 w, uint32 h)
+        {
+            rowMoments.Resize(w, h);
+            moments.Resize(w, h);
+        }
+        // Box blur of 2 * blurRadius + 1 texels, the rows and then the columns in parallel jobs. shadowMap must
+        // be the size of the moments.
+        void Filter(const RenderTarget<float>& shadowMap, uint32 blurRadius);
+        const RenderTarget<Vector4>* GetMoments() const
+        {
+            return &moments;
+        }
+    private:
+        RenderTarget<Vector4> rowMoments;
+        RenderTarget<Vector4> moments;
+    };
+
+    struct ShadowCascade
+    {
+        Matrix4x4 viewProjection;
+        // The slice of the camera frustum ends this far from the camera, along the view direction
+        float splitDistance;
+    };
+
+    // A rectangle of texels of a cascade, and the view-projection that maps the rectangle to the whole clip space.
+    // Drawn with the rectangle as viewport, a caster lands on the same texels as with the cascade's own.
+    struct ShadowRegion
+    {
+        uint32 x;
+        uint32 y;
+        uint32 width;
+        uint32 height;
+        Matrix4x4 viewProjection;
+    };
+
+    // Orthographic cascades, each fitted to a slice of the camera frustum, with a depth map and EVSM moments
+    // of size x size texels each
+    class CascadedShadowMap
+    {
+    public:
+        CascadedShadowMap(uint32 numCascades, uint32 size);
+        ~CascadedShadowMap();
+        CascadedShadowMap(const CascadedShadowMap&) = delete;
+        CascadedShadowMap& operator=(const CascadedShadowMap&) = delete;
+        void SetNumCascades(uint32 n)
+        {
+            numCascades = glm::clamp(n, (uint32)SHADOW_MIN_CASCADES, (uint32)SHADOW_MAX_CASCADES);
+        }
+        uint32 GetNumCascades() const
+        {
+            return numCascades;
+        }
+        uint32 GetSize() const
+        {
+            return size;
+        }
+        // Splits the camera frustum up to the size of the static scene, so that the splits and the size of the
+        // cascades do not change as the camera moves, and fits a cascade to each slice. The cascade covers the
+        // bounding sphere of its slice, centered on whole texels so that shadow edges do not crawl as it moves. Its
+        // depth range covers the static scene and as much again towards the light, for the dynamic casters above it.
+        void Update(const Vector3& lightDirection, const Camera& camera, const Matrix4x4& viewMatrix, const BoundingBox& staticBounds);
+        // Boxes outside the view-projection of a cascade or region cast no shadow into it
+        static bool IsCulled(const Matrix4x4& viewProjection, const BoundingBox& worldBounds);
+        // Static casters are drawn into a layer of each cascade that is kept until a static caster changes, or the
+        // light or the static bounds do. The depth of a cascade is its static layer, or a copy of it with the
+        // dynamic casters drawn over it once BeginDynamicLayer is called.
+        // UpdateStaticLayer brings the static layer to where Update placed the cascade and returns the regions the
+        // static casters must be drawn into, none when the layer is unchanged. A cascade that moved by less than
+        // its size keeps the texels it still covers, shifted in parallel row jobs, and only the uncovered border is
+        // cleared and returned. Call it before GetStaticDepth and BeginDynamicLayer, the shift swaps the layers.
+        uint32 UpdateStaticLayer(uint32 cascadeIndex, ShadowRegion outRegions[2]);
+        void InvalidateStaticLayers()
+        {
+            for (bool& valid : staticLayerValid)
+            {
+                valid = false;
+            }
+        }
+        RenderTarget<float>* GetStaticDepth(uint32 index) const
+        {
+            return staticDepths[index];
+        }
+        // Copies the static layer of the cascade in parallel row jobs and returns the copy, to draw the dynamic
+        // casters into until the next Update. Cascades without dynamic casters skip the copy.
+        RenderTarget<float>* BeginDynamicLayer(uint32 cascadeIndex);
+        const ShadowCascade& GetCascade(uint32 index) const
+        {
+            return cascades[index];
+        }
+        RenderTarget<float>* GetDepth(uint32 index) const
+        {
+            return dynamicLayerUsed[index] ? depths[index] : staticDepths[index];
+        }
+        // Filters the EVSM moments of the cascade from its depth. Moments of the static layer alone are kept and
+        // only filtered again once the layer is redrawn, a dynamic layer is used or the blur radius changes.
+        void FilterMoments(uint32 cascadeIndex, uint32 blurRadius);
+        ExponentialVarianceShadowMap* GetExponentialVarianceShadowMap(uint32 index) const
+        {
+            return exponentialVarianceShadowMaps[index];
+        }
+    private:
+        // Where a cascade lies in the light view: its first texel, counted in texels from the light view origin, its
+        // texel size and its depth range
+        struct ShadowPlacement
+        {
+            int32 originX;
+            int32 originY;
+            float texelSize;
+            float zNear;
+            float zFar;
+        };
+        Matrix4x4 GetViewProjection(const ShadowPlacement& placement, uint32 x, uint32 y, uint32 width, uint32 height) const;
+        // Copies source to destination moved by (offsetX, offsetY) texels, destination(x, y) = source(x + offsetX,
+        // y + offsetY), in parallel row jobs. Texels from outside the source are cleared.
+        void CopyLayer(const RenderTarget<float>* source, RenderTarget<float>* destination, int32 offsetX, int32 offsetY) const;
+
+        uint32 numCascades;
+        uint32 size;
+        Matrix4x4 lightView;
+        ShadowCascade cascades[SHADOW_MAX_CASCADES];
+        ShadowPlacement placements[SHADOW_MAX_CASCADES];
+        RenderTarget<float>* depths[SHADOW_MAX_CASCADES];
+        RenderTarget<float>* staticDepths[SHADOW_MAX_CASCADES];
+        ShadowPlacement staticLayerPlacements[SHADOW_MAX_CASCADES];
+        bool staticLayerValid[SHADOW_MAX_CASCADES];
+        bool dynamicLayerUsed[SHADOW_MAX_CASCADES];
+        // The moments hold the current static layer filtered with momentsBlurRadius
+        bool momentsValid[SHADOW_MAX_CASCADES];
+        uint32 momentsBlurRadius[SHADOW_MAX_CASCADES];
+        ExponentialVarianceShadowMap* exponentialVarianceShadowMaps[SHADOW_MAX_CASCADES];
+    };
+}
\ No newline at end of file
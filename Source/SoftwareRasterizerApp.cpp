@@ -75,20 +75,25 @@ namespace SR
         floorTransform.position = Vector3(0.0f, -5.0f, 0.0f);
         floorTransform.rotation = Vector3(90.0f, 0.0f, 0.0f);
         floorTransform.scale = Vector3(1.0f, 1.0f, 1.0f);
+        floorTransform.isStatic = true;
 
         rasterizer = new Rasterizer();
 
         sceneColor = new RenderTarget<glm::u8vec4>(1, 1);
         depthBuffer = new RenderTarget<float>(1, 1);
+        hizBuffer = new HiZBuffer(1, 1);
+        visibilityBuffer = new RenderTarget<uint64>(1, 1);
 
-        shadowMapSize = 1024;
-        shadowMap = new RenderTarget<float>(shadowMapSize, shadowMapSize);
-        shadowMap->Resize(shadowMapSize, shadowMapSize);
+        // 3 cascades of 512 have 3/4 of the texels of the single 1024 map they replace
+        shadowMap = new CascadedShadowMap(numShadowCascades, 512);
 
         VertexShader pbrVertexShader;
         pbrVertexShader.Main = PBRMainVS;
+        pbrVertexShader.MainBatch = PBRMainBatchVS;
         PixelShader pbrPixelShader;
         pbrPixelShader.Main = PBRMainPS;
+        pbrPixelShader.MainQuad = PBRMainQuadPS;
+        pbrPixelShader.varyingLayout = &PBRMainPSVaryingLayout;
 
         pipelineState0.vertexShader = pbrVertexShader;
         pipelineState0.pixelShader = pbrPixelShader;
@@ -100,6 +105,7 @@ namespace SR
         pipelineState0.depthCompareOp = COMPARE_OP_LESS_OR_EQUAL;
         pipelineState0.colorBuffer = sceneColor;
         pipelineState0.depthBuffer = depthBuffer;
+        pipelineState0.hizBuffer = hizBuffer;
 
         pipelineState1.vertexShader = pbrVertexShader;
         pipelineState1.pixelShader = pbrPixelShader;
@@ -111,9 +117,11 @@ namespace SR
         pipelineState1.depthCompareOp = COMPARE_OP_LESS_OR_EQUAL;
         pipelineState1.colorBuffer = sceneColor;
         pipelineState1.depthBuffer = depthBuffer;
+        pipelineState1.hizBuffer = hizBuffer;
 
-        pipelineState2.vertexShader = { ShaderMapShaderMainVS };
-        pipelineState2.pixelShader = { ShaderMapShaderMainPS };
+        pipelineState2.vertexShader = { ShaderMapShaderMainVS, ShaderMapShaderMainBatchVS };
+        // Depth-only, the depth buffer is the shadow map of the cascade being drawn
+        pipelineState2.pixelShader = {};
         pipelineState2.fillMode = FILL_MODE_SOLID;
         pipelineState2.cullMode = CULL_MODE_BACK;
         pipelineState2.frontCCW = true;
@@ -121,8 +129,7 @@ namespace SR
         pipelineState2.depthWriteEnable = true;
         pipelineState2.depthCompareOp = COMPARE_OP_LESS_OR_EQUAL;
         pipelineState2.colorBuffer = nullptr;
-        pipelineState2.depthBuffer = depthBuffer;
-        pipelineState2.shadowMap = shadowMap;
+        pipelineState2.depthBuffer = nullptr;
 
         perFrameData.gamma = 2.2f;
         perFrameData.exposure = 1.4f;
@@ -136,6 +143,8 @@ namespace SR
         delete rasterizer;
         delete sceneColor;
         delete depthBuffer;
+        delete hizBuffer;
+        delete visibilityBuffer;
         delete shadowMap;
 
         ImGuiExit();
@@ -146,10 +155,20 @@ namespace SR
 	    SR::WindowSystemExit();
     }
 
+    void SoftwareRasterizerApp::UpdateTransform(Transform& transform)
+    {
+        const Matrix4x4 world = Math::Compose(transform.position, Quaternion(Math::DegreesToRadians(transform.rotation)), transform.scale);
+        if (transform.isStatic && world != transform.world)
+        {
+            shadowMap->InvalidateStaticLayers();
+        }
+        transform.world = world;
+    }
+
     void SoftwareRasterizerApp::Update(float deltaTime)
     {
-        modelTransform.world = Math::Compose(modelTransform.position, Quaternion(Math::DegreesToRadians(modelTransform.rotation)), modelTransform.scale);
-        floorTransform.world = Math::Compose(floorTransform.position, Quaternion(Math::DegreesToRadians(floorTransform.rotation)), floorTransform.scale);
+        UpdateTransform(modelTransform);
+        UpdateTransform(floorTransform);
         
 		cameraController.Update(deltaTime, camera.position, camera.euler);
 
@@ -164,28 +183,91 @@ namespace SR
         perFrameData.mainLightColor = light.color;
         perFrameData.mainLightDirection = light.direction;
 
-        light.Update();
-
         ImGuiBeginFrame();
         OnImGui();
     }
 
     void SoftwareRasterizerApp::ShadowPass()
     {
-        depthBuffer->Resize(shadowMapSize, shadowMapSize);
-        depthBuffer->Clear(FLT_MAX);
-        shadowMap->Clear(FLT_MAX);
+        // The cascades are fitted to the static casters, so that the camera alone does not move their depths. With
+        // none, they are fitted to the dynamic ones.
+        const BoundingBox modelBounds = model.bounds.Transform(modelTransform.world);
+        const BoundingBox floorBounds = floor.bounds.Transform(floorTransform.world);
+        BoundingBox staticBounds;
+        if (modelTransform.isStatic)
+        {
+            staticBounds.Expand(modelBounds);
+        }
+        if (floorTransform.isStatic)
+        {
+            staticBounds.Expand(floorBounds);
+        }
+        if (!modelTransform.isStatic && !floorTransform.isStatic)
+        {
+            staticBounds.Expand(modelBounds);
+            staticBounds.Expand(floorBounds);
+        }
+        shadowMap->SetNumCascades((uint32)numShadowCascades);
+        shadowMap->Update(light.direction, camera, perFrameData.viewMatrix, staticBounds);
 
-        SMShaderPushConstants pc;
-        rasterizer->SetViewport(0.0f, 0.0f, (float)shadowMapSize, (float)shadowMapSize);
-        
-        pc.vertices = model.positions.data();
-        pc.mvp = light.vp * modelTransform.world;
-        rasterizer->DrawPrimitives(pipelineState2, &pc, model.numVertices, model.primitives, model.numPrimitives, camera.zNear, camera.zFar);
+        // One cascade after another, the draws of each are spread over the job system by the rasterizer
+        for (uint32 cascadeIndex = 0; cascadeIndex < shadowMap->GetNumCascades(); cascadeIndex++)
+        {
+            // Only the texels the static layer does not hold yet are drawn, each region through its own viewport
+            ShadowRegion staticRegions[2];
+            const uint32 numStaticRegions = shadowMap->UpdateStaticLayer(cascadeIndex, staticRegions);
+            pipelineState2.depthBuffer = shadowMap->GetStaticDepth(cascadeIndex);
+            for (uint32 regionIndex = 0; regionIndex < numStaticRegions; regionIndex++)
+            {
+                const ShadowRegion& region = staticRegions[regionIndex];
+                rasterizer->SetViewport((float)region.x, (float)region.y, (float)region.width, (float)region.height);
+                if (modelTransform.isStatic && !IsShadowCasterCulled(model, modelTransform, region.viewProjection))
+                {
+                    DrawShadowCaster(model, modelTransform, region.viewProjection);
+                }
+                if (floorTransform.isStatic && !IsShadowCasterCulled(floor, floorTransform, region.viewProjection))
+                {
+                    DrawShadowCaster(floor, floorTransform, region.viewProjection);
+                }
+            }
 
-        pc.vertices = floor.positions.data();
-        pc.mvp = light.vp * floorTransform.world;
-        rasterizer->DrawPrimitives(pipelineState2, &pc, floor.numVertices, floor.primitives, floor.numPrimitives, camera.zNear, camera.zFar);
+            // Dynamic casters are depth tested against the static ones, in a copy of the static layer. Without any
+            // in the cascade, the static layer is its depth as it is.
+            const Matrix4x4& viewProjection = shadowMap->GetCascade(cascadeIndex).viewProjection;
+            const bool modelIsDynamicCaster = !modelTransform.isStatic && !IsShadowCasterCulled(model, modelTransform, viewProjection);
+            const bool floorIsDynamicCaster = !floorTransform.isStatic && !IsShadowCasterCulled(floor, floorTransform, viewProjection);
+            if (modelIsDynamicCaster || floorIsDynamicCaster)
+            {
+                pipelineState2.depthBuffer = shadowMap->BeginDynamicLayer(cascadeIndex);
+                rasterizer->SetViewport(0.0f, 0.0f, (float)shadowMap->GetSize(), (float)shadowMap->GetSize());
+                if (modelIsDynamicCaster)
+                {
+                    DrawShadowCaster(model, modelTransform, viewProjection);
+                }
+                if (floorIsDynamicCaster)
+                {
+                    DrawShadowCaster(floor, floorTransform, viewProjection);
+                }
+            }
+
+            if (shadowType == SHADOW_TYPE_EVSM)
+            {
+                shadowMap->FilterMoments(cascadeIndex, (uint32)shadowBlurRadius);
+            }
+        }
+    }
+
+    bool SoftwareRasterizerApp::IsShadowCasterCulled(const Mesh& mesh, const Transform& transform, const Matrix4x4& viewProjection) const
+    {
+        return CascadedShadowMap::IsCulled(viewProjection, mesh.bounds.Transform(transform.world));
+    }
+
+    void SoftwareRasterizerApp::DrawShadowCaster(const Mesh& mesh, const Transform& transform, const Matrix4x4& viewProjection)
+    {
+        SMShaderPushConstants pc;
+        pc.vertices = mesh.positions.data();
+        pc.mvp = viewProjection * transform.world;
+        rasterizer->DrawPrimitives(pipelineState2, &pc, mesh.numVertices, mesh.primitives, mesh.numPrimitives, camera.zNear, camera.zFar);
     }
 
     void SoftwareRasterizerApp::Render()
@@ -195,6 +277,8 @@ namespace SR
         uint32 displayHeight = window->GetHeight();
         sceneColor->Resize(displayWidth, displayHeight);
         depthBuffer->Resize(displayWidth, displayHeight);
+        hizBuffer->Resize(displayWidth, displayHeight);
+        visibilityBuffer->Resize(displayWidth, displayHeight);
         
         PBRShaderPushConstants pushConstantBlock0;
         pushConstantBlock0.positions = model.positions.data();
@@ -204,7 +288,7 @@ namespace SR
         pushConstantBlock0.worldMatrix = &modelTransform.world;
         pushConstantBlock0.perFrameData = &perFrameData;
         pushConstantBlock0.material = &model.material;
-        pushConstantBlock0.lightMatrix = &light.vp;
+        pushConstantBlock0.shadowType = shadowType;
         pushConstantBlock0.shadowMap = nullptr;
         pushConstantBlock0.renderShadow = false;
 
@@ -216,7 +300,7 @@ namespace SR
         pushConstantBlock1.worldMatrix = &floorTransform.world;
         pushConstantBlock1.perFrameData = &perFrameData;
         pushConstantBlock1.material = &floor.material;
-        pushConstantBlock1.lightMatrix = &light.vp;
+        pushConstantBlock1.shadowType = shadowType;
         pushConstantBlock1.shadowMap = nullptr;
         pushConstantBlock0.renderShadow = true;
 
@@ -230,11 +314,24 @@ namespace SR
         // Clear render target
         sceneColor->Clear(glm::u8vec4(1, 1, 1, 1));
         depthBuffer->Clear(FLT_MAX);
+        hizBuffer->Clear(FLT_MAX);
+
+        pipelineState0.visibilityBuffer = visibilityBufferRendering ? visibilityBuffer : nullptr;
+        pipelineState1.visibilityBuffer = visibilityBufferRendering ? visibilityBuffer : nullptr;
+        if (visibilityBufferRendering)
+        {
+            visibilityBuffer->Clear(UINT64_MAX);
+        }
 
         rasterizer->SetViewport(0.0f, 0.0f, (float)displayWidth, (float)displayHeight);
         rasterizer->DrawPrimitives(pipelineState0, &pushConstantBlock0, model.numVertices, model.primitives, model.numPrimitives, camera.zNear, camera.zFar);
         rasterizer->DrawPrimitives(pipelineState1, &pushConstantBlock1, floor.numVertices, floor.primitives, floor.numPrimitives, camera.zNear, camera.zFar);
 
+        if (visibilityBufferRendering)
+        {
+            rasterizer->ResolveVisibilityBuffer(visibilityBuffer);
+        }
+
         UpdateSceneColorTexture(displayWidth, displayHeight, sceneColor->GetDataPtr());
         
         ImGuiEndFrame();
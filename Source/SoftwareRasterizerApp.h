@@ -5,6 +5,7 @@
 #include "CameraController.h"
 #include "Rasterizer.h"
 #include "Scene.h"
+#include "Shadows.h"
 #include "Shaders/ShaderCommon.h"
 #include "Shaders/PBRShader.h"
 #include "Shaders/ShadowMapShader.h"
@@ -41,6 +42,8 @@ namespace SR
         void Render();
 
         void ShadowPass();
+        bool IsShadowCasterCulled(const Mesh& mesh, const Transform& transform, const Matrix4x4& viewProjection) const;
+        void DrawShadowCaster(const Mesh& mesh, const Transform& transform, const Matrix4x4& viewProjection);
 
         bool IsExitRequest() const
         {
@@ -51,6 +54,9 @@ namespace SR
         
     private:
 
+        // Static shadow casters that move invalidate the cached shadow layers
+        void UpdateTransform(Transform& transform);
+
         SRWindow* window;
 
         bool isExitRequested;
@@ -73,8 +79,9 @@ namespace SR
         GraphicsPipelineState pipelineState2;
         RenderTarget<glm::u8vec4>* sceneColor;
         RenderTarget<float>* depthBuffer;
-        RenderTarget<float>* shadowMap;
-        uint32 shadowMapSize;
+        HiZBuffer* hizBuffer;
+        RenderTarget<uint64>* visibilityBuffer;
+        CascadedShadowMap* shadowMap;
 
         Rasterizer* rasterizer;
         PerFrameData perFrameData;
@@ -82,6 +89,10 @@ namespace SR
         DebugView debugView;
 
         bool renderShadow = false;
+        ShadowType shadowType = SHADOW_TYPE_PCF;
+        int numShadowCascades = 3;
+        int shadowBlurRadius = 2;
+        bool visibilityBufferRendering = false;
     };
 }
 
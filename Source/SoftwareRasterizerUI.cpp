@@ -186,7 +186,18 @@ namespace SR
 					
 					ImGui::Checkbox("Show Transform Manipulater", &showTransformManipulater);
 					ImGui::Checkbox("Show Grid", &showGrid);
-					ImGui::Checkbox("Soft Shadow (PCF)", &renderShadow);
+					ImGui::Checkbox("Soft Shadow", &renderShadow);
+					static const char* shadowTypeNames[] = {
+						"PCF",
+						"EVSM"
+					};
+					ImGui::Combo("Shadow Filter", (int*)&shadowType, shadowTypeNames, IM_ARRAYSIZE(shadowTypeNames));
+					ImGui::SliderInt("Shadow Cascades", &numShadowCascades, SHADOW_MIN_CASCADES, SHADOW_MAX_CASCADES);
+					if (shadowType == SHADOW_TYPE_EVSM)
+					{
+						ImGui::SliderInt("Shadow Blur Radius", &shadowBlurRadius, 0, 8);
+					}
+					ImGui::Checkbox("Visibility Buffer", &visibilityBufferRendering);
 					static const char* debugViewNames[] = {
 						"None",
 						"Wolrd Position",
@@ -325,6 +336,10 @@ namespace SR
 								{
 									ImportGLTF2((currentDir + "/../../Assets/Suzanne/Suzanne.gltf").c_str(), &model);
 								}
+								if (modelTransform.isStatic)
+								{
+									shadowMap->InvalidateStaticLayers();
+								}
 							}
 						}
 						ImGui::EndCombo();
@@ -383,6 +398,16 @@ namespace SR
 						ImGui::PopItemWidth();
 						ImGui::NextColumn();
 
+						ImGui::AlignTextToFramePadding();
+						ImGui::TextUnformatted("Static");
+						ImGui::NextColumn();
+						// Moves the model between the cached and the per-frame shadow casters
+						if (ImGui::Checkbox("##Static", &modelTransform.isStatic))
+						{
+							shadowMap->InvalidateStaticLayers();
+						}
+						ImGui::NextColumn();
+
 						ImGui::Columns(1);
 						ImGui::Separator();
 						ImGui::PopStyleVar();
@@ -1,64 +1,953 @@
 #include "Texture.h"
+#include "TextureCompression.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <emmintrin.h>
 
 namespace SR
 {
-    Vector4 Texture::LoadTexelAddressed(int x, int y, TextureAddressMode address) const
+    enum
     {
-        int w = (int)width;
-        int h = (int)height;
-        switch (address)
+        TEXTURE_MIP_GENERATION_ROWS_PER_JOB = 16,
+        TEXTURE_KAISER_FILTER_TAPS = 6,
+        TEXTURE_COMPRESSION_BLOCK_ROWS_PER_JOB = 4,
+        // Direct-mapped, 18 KB per thread
+        TEXTURE_DECODED_BLOCK_CACHE_SIZE = 256,
+    };
+
+    static_assert((int)TEXTURE_TILE_SIZE == (int)TEXTURE_COMPRESSION_BLOCK_SIZE, "Blocks are stored as tiles");
+
+    uint32 GetTextureFormatSize(TextureFormat format)
+    {
+        switch (format)
         {
-        case TEXTURE_ADDRESS_WARP: 
+        case TEXTURE_FORMAT_R8_UNORM:     return 1;
+        case TEXTURE_FORMAT_RG8_UNORM:    return 2;
+        case TEXTURE_FORMAT_RGBA8_UNORM:  return 4;
+        case TEXTURE_FORMAT_RGBA8_SRGB:   return 4;
+        case TEXTURE_FORMAT_RGBA16_FLOAT: return 8;
+        case TEXTURE_FORMAT_R32_FLOAT:    return 4;
+        case TEXTURE_FORMAT_RGBA32_FLOAT: return 16;
+        case TEXTURE_FORMAT_BC1_UNORM:    return 8;
+        case TEXTURE_FORMAT_BC1_SRGB:     return 8;
+        case TEXTURE_FORMAT_BC3_UNORM:    return 16;
+        case TEXTURE_FORMAT_BC3_SRGB:     return 16;
+        case TEXTURE_FORMAT_BC4_UNORM:    return 8;
+        case TEXTURE_FORMAT_BC5_UNORM:    return 16;
+        case TEXTURE_FORMAT_BC7_UNORM:    return 16;
+        case TEXTURE_FORMAT_BC7_SRGB:     return 16;
+        default:                          return 0;
+        }
+    }
+
+    static std::array<float, 256> CreateSRGBToLinearTable()
+    {
+        std::array<float, 256> table;
+        for (uint32 i = 0; i < 256; i++)
         {
-            x = COORD_MOD(x, w);
-            y = COORD_MOD(y, h);
-        } break;
-        case TEXTURE_ADDRESS_MIRROR: 
+            const float c = (float)i / 255.0f;
+            table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return table;
+    }
+
+    // Decoding an sRGB texel is a lookup, no pow runs when sampling
+    static const std::array<float, 256> srgbToLinearTable = CreateSRGBToLinearTable();
+
+    FORCEINLINE static uint8 EncodeUnorm8(float value)
+    {
+        return (uint8)(Math::Clamp(value) * 255.0f + 0.5f);
+    }
+
+    FORCEINLINE static uint8 EncodeSRGB8(float value)
+    {
+        const float c = Math::Clamp(value);
+        return EncodeUnorm8(c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f);
+    }
+
+    // Conversion between the bytes of one texel and Vector4, missing channels read as (0, 0, 0, 1)
+    template <TextureFormat Format>
+    struct TextureFormatCodec;
+
+    template <>
+    struct TextureFormatCodec<TEXTURE_FORMAT_R8_UNORM>
+    {
+        static constexpr uint32 texelSize = 1;
+        FORCEINLINE static Vector4 Decode(const uint8* texel)
+        {
+            return Vector4(texel[0] * (1.0f / 255.0f), 0.0f, 0.0f, 1.0f);
+        }
+        FORCEINLINE static void Encode(const Vector4& value, uint8* texel)
         {
-            x = COORD_MOD(x, 2 * w);
-            y = COORD_MOD(y, 2 * h);
+            texel[0] = EncodeUnorm8(value.x);
+        }
+    };
 
-            x -= w;
-            y -= h;
+    template <>
+    struct TextureFormatCodec<TEXTURE_FORMAT_RG8_UNORM>
+    {
+        static constexpr uint32 texelSize = 2;
+        FORCEINLINE static Vector4 Decode(const uint8* texel)
+        {
+            return Vector4(texel[0] * (1.0f / 255.0f), texel[1] * (1.0f / 255.0f), 0.0f, 1.0f);
+        }
+        FORCEINLINE static void Encode(const Vector4& value, uint8* texel)
+        {
+            texel[0] = EncodeUnorm8(value.x);
+            texel[1] = EncodeUnorm8(value.y);
+        }
+    };
 
-            x = COORD_MIRROR(x);
-            y = COORD_MIRROR(y);
+    template <>
+    struct TextureFormatCodec<TEXTURE_FORMAT_RGBA8_UNORM>
+    {
+        static constexpr uint32 texelSize = 4;
+        FORCEINLINE static Vector4 Decode(const uint8* texel)
+        {
+            return Vector4(texel[0], texel[1], texel[2], texel[3]) * (1.0f / 255.0f);
+        }
+        FORCEINLINE static void Encode(const Vector4& value, uint8* texel)
+        {
+            texel[0] = EncodeUnorm8(value.x);
+            texel[1] = EncodeUnorm8(value.y);
+            texel[2] = EncodeUnorm8(value.z);
+            texel[3] = EncodeUnorm8(value.w);
+        }
+    };
 
-            x = w - 1 - x;
-            y = h - 1 - y;
-        } break;
-        case TEXTURE_ADDRESS_CLAMP: 
+    template <>
+    struct TextureFormatCodec<TEXTURE_FORMAT_RGBA8_SRGB>
+    {
+        static constexpr uint32 texelSize = 4;
+        FORCEINLINE static Vector4 Decode(const uint8* texel)
+        {
+            return Vector4(srgbToLinearTable[texel[0]], srgbToLinearTable[texel[1]], srgbToLinearTable[texel[2]], texel[3] * (1.0f / 255.0f));
+        }
+        FORCEINLINE static void Encode(const Vector4& value, uint8* texel)
+        {
+            texel[0] = EncodeSRGB8(value.x);
+            texel[1] = EncodeSRGB8(value.y);
+            texel[2] = EncodeSRGB8(value.z);
+            texel[3] = EncodeUnorm8(value.w);
+        }
+    };
+
+    template <>
+    struct TextureFormatCodec<TEXTURE_FORMAT_RGBA16_FLOAT>
+    {
+        static constexpr uint32 texelSize = 8;
+        FORCEINLINE static Vector4 Decode(const uint8* texel)
+        {
+            uint64 bits;
+            memcpy(&bits, texel, sizeof(bits));
+            return glm::unpackHalf4x16(bits);
+        }
+        FORCEINLINE static void Encode(const Vector4& value, uint8* texel)
+        {
+            const uint64 bits = glm::packHalf4x16(value);
+            memcpy(texel, &bits, sizeof(bits));
+        }
+    };
+
+    template <>
+    struct TextureFormatCodec<TEXTURE_FORMAT_R32_FLOAT>
+    {
+        static constexpr uint32 texelSize = 4;
+        FORCEINLINE static Vector4 Decode(const uint8* texel)
+        {
+            float value;
+            memcpy(&value, texel, sizeof(value));
+            return Vector4(value, 0.0f, 0.0f, 1.0f);
+        }
+        FORCEINLINE static void Encode(const Vector4& value, uint8* texel)
+        {
+            memcpy(texel, &value.x, sizeof(value.x));
+        }
+    };
+
+    template <>
+    struct TextureFormatCodec<TEXTURE_FORMAT_RGBA32_FLOAT>
+    {
+        static constexpr uint32 texelSize = 16;
+        FORCEINLINE static Vector4 Decode(const uint8* texel)
+        {
+            Vector4 value;
+            memcpy(&value, texel, sizeof(value));
+            return value;
+        }
+        FORCEINLINE static void Encode(const Vector4& value, uint8* texel)
+        {
+            memcpy(texel, &value, sizeof(value));
+        }
+    };
+
+    // Block-compressed formats decode a block to RGBA8 texels, which are then converted like RGBA8 texels
+    template <TextureFormat DecodedFormat, uint32 BlockSize, void(*DecodeBlockFunc)(const uint8*, uint8*)>
+    struct BlockCompressedFormatCodec : TextureFormatCodec<DecodedFormat>
+    {
+        static constexpr uint32 blockSize = BlockSize;
+        FORCEINLINE static void DecodeBlock(const uint8* block, uint8* texels)
+        {
+            DecodeBlockFunc(block, texels);
+        }
+    };
+
+    template <> struct TextureFormatCodec<TEXTURE_FORMAT_BC1_UNORM> : BlockCompressedFormatCodec<TEXTURE_FORMAT_RGBA8_UNORM, 8, DecodeBC1Block> {};
+    template <> struct TextureFormatCodec<TEXTURE_FORMAT_BC1_SRGB>  : BlockCompressedFormatCodec<TEXTURE_FORMAT_RGBA8_SRGB, 8, DecodeBC1Block> {};
+    template <> struct TextureFormatCodec<TEXTURE_FORMAT_BC3_UNORM> : BlockCompressedFormatCodec<TEXTURE_FORMAT_RGBA8_UNORM, 16, DecodeBC3Block> {};
+    template <> struct TextureFormatCodec<TEXTURE_FORMAT_BC3_SRGB>  : BlockCompressedFormatCodec<TEXTURE_FORMAT_RGBA8_SRGB, 16, DecodeBC3Block> {};
+    template <> struct TextureFormatCodec<TEXTURE_FORMAT_BC4_UNORM> : BlockCompressedFormatCodec<TEXTURE_FORMAT_RGBA8_UNORM, 8, DecodeBC4Block> {};
+    template <> struct TextureFormatCodec<TEXTURE_FORMAT_BC5_UNORM> : BlockCompressedFormatCodec<TEXTURE_FORMAT_RGBA8_UNORM, 16, DecodeBC5Block> {};
+    template <> struct TextureFormatCodec<TEXTURE_FORMAT_BC7_UNORM> : BlockCompressedFormatCodec<TEXTURE_FORMAT_RGBA8_UNORM, 16, DecodeBC7Block> {};
+    template <> struct TextureFormatCodec<TEXTURE_FORMAT_BC7_SRGB>  : BlockCompressedFormatCodec<TEXTURE_FORMAT_RGBA8_SRGB, 16, DecodeBC7Block> {};
+
+    struct DecodedBlock
+    {
+        // Block cache ID of the texture in the high 32 bits, block index in the low 32 bits
+        uint64 tag;
+        uint8 texels[TEXTURE_COMPRESSION_BLOCK_TEXELS * 4];
+    };
+
+    // Per thread, so lookups need no synchronization. Tags are zero initialized and block cache IDs start at 1.
+    static thread_local DecodedBlock decodedBlockCache[TEXTURE_DECODED_BLOCK_CACHE_SIZE];
+    static std::atomic<uint32> nextBlockCacheID = 1;
+
+    template <TextureFormat Format, typename Func>
+    FORCEINLINE static auto DispatchTextureLayout(TextureLayout layout, Func& func)
+    {
+        using FormatConstant = std::integral_constant<TextureFormat, Format>;
+        using TiledConstant = std::integral_constant<TextureLayout, TEXTURE_LAYOUT_TILED>;
+        using LinearConstant = std::integral_constant<TextureLayout, TEXTURE_LAYOUT_LINEAR>;
+        // Blocks are always tiles
+        if constexpr (IsBlockCompressedFormat(Format))
+        {
+            return func(FormatConstant(), TiledConstant());
+        }
+        else
         {
-            if (x < 0) x = 0;
-            if (y < 0) y = 0;
-            if (x >= w) x = w - 1;
-            if (y >= h) y = h - 1;
-        } break;
+            return layout == TEXTURE_LAYOUT_TILED ? func(FormatConstant(), TiledConstant()) : func(FormatConstant(), LinearConstant());
+        }
+    }
+
+    // Calls func with std::integral_constant arguments of the format and the layout, so the code it
+    // instantiates is specialized for both
+    template <typename Func>
+    static auto DispatchTextureFormat(TextureFormat format, TextureLayout layout, Func&& func)
+    {
+        switch (format)
+        {
+        case TEXTURE_FORMAT_R8_UNORM:     return DispatchTextureLayout<TEXTURE_FORMAT_R8_UNORM>(layout, func);
+        case TEXTURE_FORMAT_RG8_UNORM:    return DispatchTextureLayout<TEXTURE_FORMAT_RG8_UNORM>(layout, func);
+        case TEXTURE_FORMAT_RGBA8_UNORM:  return DispatchTextureLayout<TEXTURE_FORMAT_RGBA8_UNORM>(layout, func);
+        case TEXTURE_FORMAT_RGBA8_SRGB:   return DispatchTextureLayout<TEXTURE_FORMAT_RGBA8_SRGB>(layout, func);
+        case TEXTURE_FORMAT_RGBA16_FLOAT: return DispatchTextureLayout<TEXTURE_FORMAT_RGBA16_FLOAT>(layout, func);
+        case TEXTURE_FORMAT_R32_FLOAT:    return DispatchTextureLayout<TEXTURE_FORMAT_R32_FLOAT>(layout, func);
+        case TEXTURE_FORMAT_RGBA32_FLOAT: return DispatchTextureLayout<TEXTURE_FORMAT_RGBA32_FLOAT>(layout, func);
+        case TEXTURE_FORMAT_BC1_UNORM:    return DispatchTextureLayout<TEXTURE_FORMAT_BC1_UNORM>(layout, func);
+        case TEXTURE_FORMAT_BC1_SRGB:     return DispatchTextureLayout<TEXTURE_FORMAT_BC1_SRGB>(layout, func);
+        case TEXTURE_FORMAT_BC3_UNORM:    return DispatchTextureLayout<TEXTURE_FORMAT_BC3_UNORM>(layout, func);
+        case TEXTURE_FORMAT_BC3_SRGB:     return DispatchTextureLayout<TEXTURE_FORMAT_BC3_SRGB>(layout, func);
+        case TEXTURE_FORMAT_BC4_UNORM:    return DispatchTextureLayout<TEXTURE_FORMAT_BC4_UNORM>(layout, func);
+        case TEXTURE_FORMAT_BC5_UNORM:    return DispatchTextureLayout<TEXTURE_FORMAT_BC5_UNORM>(layout, func);
+        case TEXTURE_FORMAT_BC7_UNORM:    return DispatchTextureLayout<TEXTURE_FORMAT_BC7_UNORM>(layout, func);
+        case TEXTURE_FORMAT_BC7_SRGB:     return DispatchTextureLayout<TEXTURE_FORMAT_BC7_SRGB>(layout, func);
+        default:                          return DispatchTextureLayout<TEXTURE_FORMAT_RGBA32_FLOAT>(layout, func);
+        }
+    }
+
+    Texture::MipLevel Texture::CreateMipLevel(uint32 w, uint32 h, uint32 offset) const
+    {
+        return { w, h, offset, (w + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE, 1.0f / (float)w, 1.0f / (float)h };
+    }
+
+    uint32 Texture::GetMipLevelSize(const MipLevel& mip) const
+    {
+        const uint32 numTilesY = (mip.height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+        if (IsBlockCompressedFormat(format))
+        {
+            return mip.numTilesX * numTilesY;
+        }
+        if (layout == TEXTURE_LAYOUT_TILED)
+        {
+            return mip.numTilesX * numTilesY * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE;
+        }
+        return mip.width * mip.height;
+    }
+
+    void Texture::AllocateMips(uint32 numMipLevels)
+    {
+        mips.resize(numMipLevels);
+        uint32 size = GetMipLevelSize(mips[0]);
+        for (uint32 mipLevel = 1; mipLevel < numMipLevels; mipLevel++)
+        {
+            mips[mipLevel] = CreateMipLevel(std::max(width >> mipLevel, 1u), std::max(height >> mipLevel, 1u), size);
+            size += GetMipLevelSize(mips[mipLevel]);
+        }
+        buffer.resize((size_t)size * texelSize);
+    }
+
+    template <TextureLayout Layout>
+    FORCEINLINE uint32 Texture::GetTexelIndex(const MipLevel& mip, uint32 x, uint32 y)
+    {
+        if (Layout == TEXTURE_LAYOUT_TILED)
+        {
+            // Interleave the 2 low bits of x and y
+            const uint32 tile = (y >> 2) * mip.numTilesX + (x >> 2);
+            const uint32 morton = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+            return mip.offset + tile * (TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE) + morton;
+        }
+        return mip.offset + y * mip.width + x;
+    }
+
+    uint32 Texture::GetTexelIndex(const MipLevel& mip, uint32 x, uint32 y) const
+    {
+        return layout == TEXTURE_LAYOUT_TILED ? GetTexelIndex<TEXTURE_LAYOUT_TILED>(mip, x, y) : GetTexelIndex<TEXTURE_LAYOUT_LINEAR>(mip, x, y);
+    }
+
+    void Texture::Resize(uint32 w, uint32 h, TextureFormat textureFormat, TextureLayout textureLayout, uint32 numMipLevels)
+    {
+        width = w;
+        height = h;
+        format = textureFormat;
+        layout = IsBlockCompressedFormat(textureFormat) ? TEXTURE_LAYOUT_TILED : textureLayout;
+        texelSize = GetTextureFormatSize(textureFormat);
+        powerOfTwo = Math::IsPowerOfTwo(w) && Math::IsPowerOfTwo(h);
+        blockCacheID = nextBlockCacheID++;
+        mips.assign(1, CreateMipLevel(w, h, 0));
+        AllocateMips(numMipLevels);
+    }
+
+    void Texture::SetData(const void* data, uint32 mipLevel)
+    {
+        const MipLevel& mip = mips[mipLevel];
+        const uint8* source = (const uint8*)data;
+        blockCacheID = nextBlockCacheID++;
+        if (layout == TEXTURE_LAYOUT_LINEAR || IsBlockCompressedFormat(format))
+        {
+            memcpy(&buffer[(size_t)mip.offset * texelSize], source, (size_t)GetMipLevelSize(mip) * texelSize);
+            return;
+        }
+        for (uint32 y = 0; y < mip.height; y++)
+        {
+            for (uint32 x = 0; x < mip.width; x++)
+            {
+                memcpy(&buffer[(size_t)GetTexelIndex<TEXTURE_LAYOUT_TILED>(mip, x, y) * texelSize], &source[((size_t)y * mip.width + x) * texelSize], texelSize);
+            }
+        }
+    }
+
+    template <TextureFormat Format>
+    FORCEINLINE const uint8* Texture::FetchBlock(uint32 blockIndex) const
+    {
+        using Codec = TextureFormatCodec<Format>;
+        const uint64 tag = ((uint64)blockCacheID << 32) | blockIndex;
+        // Neighboring blocks map to different entries, the ID spreads textures over the cache
+        DecodedBlock& entry = decodedBlockCache[(blockIndex ^ (blockCacheID * 0x9E3779B1u)) & (TEXTURE_DECODED_BLOCK_CACHE_SIZE - 1)];
+        if (entry.tag != tag)
+        {
+            Codec::DecodeBlock(&buffer[(size_t)blockIndex * Codec::blockSize], entry.texels);
+            entry.tag = tag;
+        }
+        return entry.texels;
+    }
+
+    template <TextureFormat Format, TextureLayout Layout>
+    FORCEINLINE Vector4 Texture::ReadTexel(const MipLevel& mip, uint32 x, uint32 y) const
+    {
+        if constexpr (IsBlockCompressedFormat(Format))
+        {
+            const uint32 blockIndex = mip.offset + (y / TEXTURE_COMPRESSION_BLOCK_SIZE) * mip.numTilesX + x / TEXTURE_COMPRESSION_BLOCK_SIZE;
+            const uint32 texelIndex = (y % TEXTURE_COMPRESSION_BLOCK_SIZE) * TEXTURE_COMPRESSION_BLOCK_SIZE + x % TEXTURE_COMPRESSION_BLOCK_SIZE;
+            return TextureFormatCodec<Format>::Decode(FetchBlock<Format>(blockIndex) + texelIndex * TextureFormatCodec<Format>::texelSize);
+        }
+        else
+        {
+            const size_t index = GetTexelIndex<Layout>(mip, x, y);
+            return TextureFormatCodec<Format>::Decode(&buffer[index * TextureFormatCodec<Format>::texelSize]);
+        }
+    }
+
+    template <TextureFormat Format, TextureLayout Layout, TextureAddressMode Address, bool PowerOfTwo>
+    FORCEINLINE Vector4 Texture::FetchTexel(int x, int y, uint32 mipLevel) const
+    {
+        const MipLevel& mip = mips[mipLevel];
+        const int addressedX = AddressTexelCoord<Address, PowerOfTwo>(x, (int)mip.width, mip.widthReciprocal);
+        const int addressedY = AddressTexelCoord<Address, PowerOfTwo>(y, (int)mip.height, mip.heightReciprocal);
+        return ReadTexel<Format, Layout>(mip, (uint32)addressedX, (uint32)addressedY);
+    }
+
+    FORCEINLINE static __m128 FloorSSE(__m128 value)
+    {
+        // Truncation rounds negative values up
+        const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(value));
+        return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, value), _mm_set1_ps(1.0f)));
+    }
+
+    // AddressTexelCoord for the 4 lanes, the integral coordinates are given as floats
+    template <TextureAddressMode Address, bool PowerOfTwo>
+    FORCEINLINE static __m128i AddressTexelsSSE(__m128 coord, int size, float sizeReciprocal)
+    {
+        if constexpr (Address == TEXTURE_ADDRESS_CLAMP)
+        {
+            return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(coord, _mm_setzero_ps()), _mm_set1_ps((float)(size - 1))));
+        }
+        else
+        {
+            const int period = Address == TEXTURE_ADDRESS_MIRROR ? 2 * size : size;
+            __m128i wrapped;
+            if constexpr (PowerOfTwo)
+            {
+                wrapped = _mm_and_si128(_mm_cvttps_epi32(coord), _mm_set1_epi32(period - 1));
+            }
+            else
+            {
+                const float periodReciprocal = Address == TEXTURE_ADDRESS_MIRROR ? 0.5f * sizeReciprocal : sizeReciprocal;
+                const __m128 periodVector = _mm_set1_ps((float)period);
+                const __m128 quotient = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(coord, _mm_set1_ps(periodReciprocal))));
+                __m128 remainder = _mm_sub_ps(coord, _mm_mul_ps(quotient, periodVector));
+                remainder = _mm_add_ps(remainder, _mm_and_ps(_mm_cmplt_ps(remainder, _mm_setzero_ps()), periodVector));
+                remainder = _mm_sub_ps(remainder, _mm_and_ps(_mm_cmpge_ps(remainder, periodVector), periodVector));
+                wrapped = _mm_cvttps_epi32(remainder);
+            }
+            if constexpr (Address == TEXTURE_ADDRESS_MIRROR)
+            {
+                const __m128i reflected = _mm_sub_epi32(_mm_set1_epi32(period - 1), wrapped);
+                const __m128i mask = _mm_cmpgt_epi32(wrapped, _mm_set1_epi32(size - 1));
+                wrapped = _mm_or_si128(_mm_and_si128(mask, reflected), _mm_andnot_si128(mask, wrapped));
+            }
+            return wrapped;
+        }
+    }
+
+    template <TextureFormat Format, TextureLayout Layout, TextureAddressMode Address, bool PowerOfTwo>
+    void Texture::SampleMipLevelQuad(const Vector2 uv[TEXTURE_QUAD_SIZE], uint32 mipLevel, float weight, Vector4 inOutTexels[TEXTURE_QUAD_SIZE]) const
+    {
+        const MipLevel& mip = mips[mipLevel];
+        const __m128 u = _mm_setr_ps(uv[0].x, uv[1].x, uv[2].x, uv[3].x);
+        const __m128 v = _mm_setr_ps(uv[0].y, uv[1].y, uv[2].y, uv[3].y);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 x = _mm_sub_ps(_mm_mul_ps(u, _mm_set1_ps((float)mip.width)), half);
+        const __m128 y = _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps((float)mip.height)), half);
+        const __m128 x0 = FloorSSE(x);
+        const __m128 y0 = FloorSSE(y);
+        const __m128 fx = _mm_sub_ps(x, x0);
+        const __m128 fy = _mm_sub_ps(y, y0);
+
+        // Weights of the texels (x0, y0), (x1, y0), (x0, y1) and (x1, y1), per lane
+        alignas(16) float weights[4][TEXTURE_QUAD_SIZE];
+        const __m128 weightVector = _mm_set1_ps(weight);
+        const __m128 wy0 = _mm_mul_ps(_mm_sub_ps(one, fy), weightVector);
+        const __m128 wy1 = _mm_mul_ps(fy, weightVector);
+        _mm_store_ps(weights[0], _mm_mul_ps(_mm_sub_ps(one, fx), wy0));
+        _mm_store_ps(weights[1], _mm_mul_ps(fx, wy0));
+        _mm_store_ps(weights[2], _mm_mul_ps(_mm_sub_ps(one, fx), wy1));
+        _mm_store_ps(weights[3], _mm_mul_ps(fx, wy1));
+
+        alignas(16) int xs[2][TEXTURE_QUAD_SIZE];
+        alignas(16) int ys[2][TEXTURE_QUAD_SIZE];
+        _mm_store_si128((__m128i*)xs[0], AddressTexelsSSE<Address, PowerOfTwo>(x0, (int)mip.width, mip.widthReciprocal));
+        _mm_store_si128((__m128i*)xs[1], AddressTexelsSSE<Address, PowerOfTwo>(_mm_add_ps(x0, one), (int)mip.width, mip.widthReciprocal));
+        _mm_store_si128((__m128i*)ys[0], AddressTexelsSSE<Address, PowerOfTwo>(y0, (int)mip.height, mip.heightReciprocal));
+        _mm_store_si128((__m128i*)ys[1], AddressTexelsSSE<Address, PowerOfTwo>(_mm_add_ps(y0, one), (int)mip.height, mip.heightReciprocal));
+
+        for (uint32 lane = 0; lane < TEXTURE_QUAD_SIZE; lane++)
+        {
+            __m128 result = _mm_loadu_ps(&inOutTexels[lane].x);
+            for (uint32 i = 0; i < 4; i++)
+            {
+                const Vector4 texel = ReadTexel<Format, Layout>(mip, (uint32)xs[i & 1][lane], (uint32)ys[i >> 1][lane]);
+                result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(&texel.x), _mm_set1_ps(weights[i][lane])));
+            }
+            _mm_storeu_ps(&inOutTexels[lane].x, result);
+        }
+    }
+
+    template <TextureFormat Format, TextureLayout Layout, FilterMode Filter, TextureAddressMode Address, bool PowerOfTwo>
+    FORCEINLINE Vector4 Texture::SampleMipLevel(const Vector2& uv, uint32 mipLevel) const
+    {
+        const uint32 width = mips[mipLevel].width;
+        const uint32 height = mips[mipLevel].height;
+        if constexpr (Filter == TEXTURE_FILTER_NEAREST)
+        {
+            Vector2 xy = glm::floor(uv * Vector2(width, height));
+            int x = (int)xy.x;
+            int y = (int)xy.y;
+
+            return FetchTexel<Format, Layout, Address, PowerOfTwo>(x, y, mipLevel);
+        }
+        else
+        {
+            Vector2 xy = uv * Vector2(width, height) - Vector2(0.5f);
+            auto x = (int)std::floor(xy.x);
+            auto y = (int)std::floor(xy.y);
+
+            Vector4 texel0 = FetchTexel<Format, Layout, Address, PowerOfTwo>(x + 0, y + 0, mipLevel);
+            Vector4 texel1 = FetchTexel<Format, Layout, Address, PowerOfTwo>(x + 1, y + 0, mipLevel);
+            Vector4 texel2 = FetchTexel<Format, Layout, Address, PowerOfTwo>(x + 0, y + 1, mipLevel);
+            Vector4 texel3 = FetchTexel<Format, Layout, Address, PowerOfTwo>(x + 1, y + 1, mipLevel);
+
+            xy = glm::fract(xy);
+            return glm::mix(glm::mix(texel0, texel1, xy.x), glm::mix(texel2, texel3, xy.x), xy.y);
+        }
+    }
+
+    FORCEINLINE static float ClampLevelOfDetail(float lod, uint32 numMipLevels)
+    {
+        // Also catches NaN and -inf from zero derivatives
+        if (!(lod > 0.0f))
+        {
+            lod = 0.0f;
+        }
+        return std::min(lod, (float)(numMipLevels - 1));
+    }
+
+    template <TextureFormat Format, TextureLayout Layout, FilterMode Filter, TextureAddressMode Address, bool PowerOfTwo>
+    Vector4 Texture::SampleLevel(const Vector2& uv, float lod) const
+    {
+        lod = ClampLevelOfDetail(lod, (uint32)mips.size());
+        if constexpr (Filter != TEXTURE_FILTER_TRILINEAR)
+        {
+            return SampleMipLevel<Format, Layout, Filter, Address, PowerOfTwo>(uv, (uint32)(lod + 0.5f));
+        }
+        else
+        {
+            const uint32 mipLevel = (uint32)lod;
+            const float t = lod - (float)mipLevel;
+            const Vector4 texel0 = SampleMipLevel<Format, Layout, TEXTURE_FILTER_LINEAR, Address, PowerOfTwo>(uv, mipLevel);
+            if (t == 0.0f)
+            {
+                return texel0;
+            }
+            return glm::mix(texel0, SampleMipLevel<Format, Layout, TEXTURE_FILTER_LINEAR, Address, PowerOfTwo>(uv, mipLevel + 1), t);
+        }
+    }
+
+    template <TextureFormat Format, TextureLayout Layout, FilterMode Filter, TextureAddressMode Address, bool PowerOfTwo>
+    void Texture::SampleLevelQuad(const Vector2 uv[TEXTURE_QUAD_SIZE], float lod, Vector4 outTexels[TEXTURE_QUAD_SIZE]) const
+    {
+        lod = ClampLevelOfDetail(lod, (uint32)mips.size());
+        if constexpr (Filter == TEXTURE_FILTER_NEAREST)
+        {
+            const uint32 mipLevel = (uint32)(lod + 0.5f);
+            for (uint32 lane = 0; lane < TEXTURE_QUAD_SIZE; lane++)
+            {
+                outTexels[lane] = SampleMipLevel<Format, Layout, Filter, Address, PowerOfTwo>(uv[lane], mipLevel);
+            }
+            return;
+        }
+        for (uint32 lane = 0; lane < TEXTURE_QUAD_SIZE; lane++)
+        {
+            outTexels[lane] = Vector4(0.0f);
+        }
+        if constexpr (Filter == TEXTURE_FILTER_LINEAR)
+        {
+            SampleMipLevelQuad<Format, Layout, Address, PowerOfTwo>(uv, (uint32)(lod + 0.5f), 1.0f, outTexels);
+        }
+        else
+        {
+            const uint32 mipLevel = (uint32)lod;
+            const float t = lod - (float)mipLevel;
+            SampleMipLevelQuad<Format, Layout, Address, PowerOfTwo>(uv, mipLevel, 1.0f - t, outTexels);
+            if (t != 0.0f)
+            {
+                SampleMipLevelQuad<Format, Layout, Address, PowerOfTwo>(uv, mipLevel + 1, t, outTexels);
+            }
+        }
+    }
+
+    template <TextureAddressMode Address>
+    Vector4 Texture::LoadTexelAddressed(int x, int y, uint32 mipLevel) const
+    {
+        return DispatchTextureFormat(format, layout, [&](auto formatConstant, auto layoutConstant)
+        {
+            constexpr TextureFormat Format = decltype(formatConstant)::value;
+            constexpr TextureLayout Layout = decltype(layoutConstant)::value;
+            return powerOfTwo ? FetchTexel<Format, Layout, Address, true>(x, y, mipLevel) : FetchTexel<Format, Layout, Address, false>(x, y, mipLevel);
+        });
+    }
+
+    Vector4 Texture::LoadTexelAddressed(int x, int y, TextureAddressMode address, uint32 mipLevel) const
+    {
+        switch (address)
+        {
+        case TEXTURE_ADDRESS_MIRROR:   return LoadTexelAddressed<TEXTURE_ADDRESS_MIRROR>(x, y, mipLevel);
+        case TEXTURE_ADDRESS_CLAMP:    return LoadTexelAddressed<TEXTURE_ADDRESS_CLAMP>(x, y, mipLevel);
+        default:                       return LoadTexelAddressed<TEXTURE_ADDRESS_WARP>(x, y, mipLevel);
+        }
+    }
+
+    Vector4 Texture::LoadTexel(uint32 x, uint32 y, uint32 mipLevel) const
+    {
+        const MipLevel& mip = mips[mipLevel];
+        if (x >= mip.width || y >= mip.height)
+        {
+            return Vector4(0.0f);
+        }
+        if (IsBlockCompressedFormat(format))
+        {
+            return LoadTexelAddressed((int)x, (int)y, TEXTURE_ADDRESS_CLAMP, mipLevel);
+        }
+        const uint8* texel = &buffer[(size_t)GetTexelIndex(mip, x, y) * texelSize];
+        switch (format)
+        {
+        case TEXTURE_FORMAT_R8_UNORM:     return TextureFormatCodec<TEXTURE_FORMAT_R8_UNORM>::Decode(texel);
+        case TEXTURE_FORMAT_RG8_UNORM:    return TextureFormatCodec<TEXTURE_FORMAT_RG8_UNORM>::Decode(texel);
+        case TEXTURE_FORMAT_RGBA8_UNORM:  return TextureFormatCodec<TEXTURE_FORMAT_RGBA8_UNORM>::Decode(texel);
+        case TEXTURE_FORMAT_RGBA8_SRGB:   return TextureFormatCodec<TEXTURE_FORMAT_RGBA8_SRGB>::Decode(texel);
+        case TEXTURE_FORMAT_RGBA16_FLOAT: return TextureFormatCodec<TEXTURE_FORMAT_RGBA16_FLOAT>::Decode(texel);
+        case TEXTURE_FORMAT_R32_FLOAT:    return TextureFormatCodec<TEXTURE_FORMAT_R32_FLOAT>::Decode(texel);
+        case TEXTURE_FORMAT_RGBA32_FLOAT: return TextureFormatCodec<TEXTURE_FORMAT_RGBA32_FLOAT>::Decode(texel);
+        default:                          return Vector4(0.0f);
+        }
+    }
+
+    void Texture::StoreTexel(uint32 x, uint32 y, const Vector4& value, uint32 mipLevel)
+    {
+        const MipLevel& mip = mips[mipLevel];
+        uint8* texel = &buffer[(size_t)GetTexelIndex(mip, x, y) * texelSize];
+        switch (format)
+        {
+        case TEXTURE_FORMAT_R8_UNORM:     TextureFormatCodec<TEXTURE_FORMAT_R8_UNORM>::Encode(value, texel); break;
+        case TEXTURE_FORMAT_RG8_UNORM:    TextureFormatCodec<TEXTURE_FORMAT_RG8_UNORM>::Encode(value, texel); break;
+        case TEXTURE_FORMAT_RGBA8_UNORM:  TextureFormatCodec<TEXTURE_FORMAT_RGBA8_UNORM>::Encode(value, texel); break;
+        case TEXTURE_FORMAT_RGBA8_SRGB:   TextureFormatCodec<TEXTURE_FORMAT_RGBA8_SRGB>::Encode(value, texel); break;
+        case TEXTURE_FORMAT_RGBA16_FLOAT: TextureFormatCodec<TEXTURE_FORMAT_RGBA16_FLOAT>::Encode(value, texel); break;
+        case TEXTURE_FORMAT_R32_FLOAT:    TextureFormatCodec<TEXTURE_FORMAT_R32_FLOAT>::Encode(value, texel); break;
+        case TEXTURE_FORMAT_RGBA32_FLOAT: TextureFormatCodec<TEXTURE_FORMAT_RGBA32_FLOAT>::Encode(value, texel); break;
         default: break;
         }
-        return LoadTexel(x, y);
     }
 
+    template <FilterMode Filter, TextureAddressMode Address>
+    Vector4 Texture::Sample(ImmutableSampler<Filter, Address> sampler, const Vector2& uv) const
+    {
+        return SampleLevel(sampler, uv, 0.0f);
+    }
+
+    template <FilterMode Filter, TextureAddressMode Address>
+    Vector4 Texture::SampleGrad(ImmutableSampler<Filter, Address> sampler, const Vector2& uv, const Vector2& ddx, const Vector2& ddy) const
+    {
+        return SampleLevel(sampler, uv, CalculateLevelOfDetail(sampler, ddx, ddy));
+    }
+
+    // The format, the layout and whether the texture is a power of two are resolved once per sample
+    template <FilterMode Filter, TextureAddressMode Address>
+    Vector4 Texture::SampleLevel(ImmutableSampler<Filter, Address> /*sampler*/, const Vector2& uv, float lod) const
+    {
+        return DispatchTextureFormat(format, layout, [&](auto formatConstant, auto layoutConstant)
+        {
+            constexpr TextureFormat Format = decltype(formatConstant)::value;
+            constexpr TextureLayout Layout = decltype(layoutConstant)::value;
+            return powerOfTwo ? SampleLevel<Format, Layout, Filter, Address, true>(uv, lod) : SampleLevel<Format, Layout, Filter, Address, false>(uv, lod);
+        });
+    }
+
+    template <FilterMode Filter, TextureAddressMode Address>
+    void Texture::SampleGradQuad(ImmutableSampler<Filter, Address> sampler, const Vector2 uv[TEXTURE_QUAD_SIZE], const Vector2& ddx, const Vector2& ddy, Vector4 outTexels[TEXTURE_QUAD_SIZE]) const
+    {
+        SampleLevelQuad(sampler, uv, CalculateLevelOfDetail(sampler, ddx, ddy), outTexels);
+    }
+
+    template <FilterMode Filter, TextureAddressMode Address>
+    void Texture::SampleLevelQuad(ImmutableSampler<Filter, Address> /*sampler*/, const Vector2 uv[TEXTURE_QUAD_SIZE], float lod, Vector4 outTexels[TEXTURE_QUAD_SIZE]) const
+    {
+        DispatchTextureFormat(format, layout, [&](auto formatConstant, auto layoutConstant)
+        {
+            constexpr TextureFormat Format = decltype(formatConstant)::value;
+            constexpr TextureLayout Layout = decltype(layoutConstant)::value;
+            powerOfTwo ? SampleLevelQuad<Format, Layout, Filter, Address, true>(uv, lod, outTexels) : SampleLevelQuad<Format, Layout, Filter, Address, false>(uv, lod, outTexels);
+        });
+    }
+
+#define TEXTURE_INSTANTIATE_IMMUTABLE_SAMPLER(Filter, Address) \
+    template Vector4 Texture::Sample(ImmutableSampler<Filter, Address>, const Vector2&) const; \
+    template Vector4 Texture::SampleGrad(ImmutableSampler<Filter, Address>, const Vector2&, const Vector2&, const Vector2&) const; \
+    template Vector4 Texture::SampleLevel(ImmutableSampler<Filter, Address>, const Vector2&, float) const; \
+    template void Texture::SampleGradQuad(ImmutableSampler<Filter, Address>, const Vector2[TEXTURE_QUAD_SIZE], const Vector2&, const Vector2&, Vector4[TEXTURE_QUAD_SIZE]) const; \
+    template void Texture::SampleLevelQuad(ImmutableSampler<Filter, Address>, const Vector2[TEXTURE_QUAD_SIZE], float, Vector4[TEXTURE_QUAD_SIZE]) const;
+
+    TEXTURE_INSTANTIATE_IMMUTABLE_SAMPLER(TEXTURE_FILTER_NEAREST, TEXTURE_ADDRESS_WARP)
+    TEXTURE_INSTANTIATE_IMMUTABLE_SAMPLER(TEXTURE_FILTER_NEAREST, TEXTURE_ADDRESS_MIRROR)
+    TEXTURE_INSTANTIATE_IMMUTABLE_SAMPLER(TEXTURE_FILTER_NEAREST, TEXTURE_ADDRESS_CLAMP)
+    TEXTURE_INSTANTIATE_IMMUTABLE_SAMPLER(TEXTURE_FILTER_LINEAR, TEXTURE_ADDRESS_WARP)
+    TEXTURE_INSTANTIATE_IMMUTABLE_SAMPLER(TEXTURE_FILTER_LINEAR, TEXTURE_ADDRESS_MIRROR)
+    TEXTURE_INSTANTIATE_IMMUTABLE_SAMPLER(TEXTURE_FILTER_LINEAR, TEXTURE_ADDRESS_CLAMP)
+    TEXTURE_INSTANTIATE_IMMUTABLE_SAMPLER(TEXTURE_FILTER_TRILINEAR, TEXTURE_ADDRESS_WARP)
+    TEXTURE_INSTANTIATE_IMMUTABLE_SAMPLER(TEXTURE_FILTER_TRILINEAR, TEXTURE_ADDRESS_MIRROR)
+    TEXTURE_INSTANTIATE_IMMUTABLE_SAMPLER(TEXTURE_FILTER_TRILINEAR, TEXTURE_ADDRESS_CLAMP)
+
+#undef TEXTURE_INSTANTIATE_IMMUTABLE_SAMPLER
+
     Vector4 Texture::Sample(const SamplerState& smapler, const Vector2& uv) const
     {
-        if (smapler.filter == TEXTURE_FILTER_NEAREST)
+        return DispatchSamplerState(smapler, [&](auto sampler) { return Sample(sampler, uv); });
+    }
+
+    float Texture::CalculateLevelOfDetail(const SamplerState& smapler, const Vector2& ddx, const Vector2& ddy) const
+    {
+        // Footprint of the pixel in level 0 texels, along the longer screen axis
+        const Vector2 size = Vector2(width, height);
+        const Vector2 dx = ddx * size;
+        const Vector2 dy = ddy * size;
+        const float rhoSquared = std::max(glm::dot(dx, dx), glm::dot(dy, dy));
+        return 0.5f * std::log2(rhoSquared) + smapler.mipLodBias;
+    }
+
+    Vector4 Texture::SampleGrad(const SamplerState& smapler, const Vector2& uv, const Vector2& ddx, const Vector2& ddy) const
+    {
+        return SampleLevel(smapler, uv, CalculateLevelOfDetail(smapler, ddx, ddy));
+    }
+
+    Vector4 Texture::SampleLevel(const SamplerState& smapler, const Vector2& uv, float lod) const
+    {
+        return DispatchSamplerState(smapler, [&](auto sampler) { return SampleLevel(sampler, uv, lod); });
+    }
+
+    void Texture::SampleGradQuad(const SamplerState& smapler, const Vector2 uv[TEXTURE_QUAD_SIZE], const Vector2& ddx, const Vector2& ddy, Vector4 outTexels[TEXTURE_QUAD_SIZE]) const
+    {
+        SampleLevelQuad(smapler, uv, CalculateLevelOfDetail(smapler, ddx, ddy), outTexels);
+    }
+
+    void Texture::SampleLevelQuad(const SamplerState& smapler, const Vector2 uv[TEXTURE_QUAD_SIZE], float lod, Vector4 outTexels[TEXTURE_QUAD_SIZE]) const
+    {
+        DispatchSamplerState(smapler, [&](auto sampler) { SampleLevelQuad(sampler, uv, lod, outTexels); });
+    }
+
+    static float BesselI0(float x)
+    {
+        // Power series, converges quickly for the small arguments of the Kaiser window
+        float sum = 1.0f;
+        float term = 1.0f;
+        for (uint32 k = 1; k < 16; k++)
         {
-            Vector2 xy = uv * Vector2(width, height);
-            int x = (int)xy.x;
-            int y = static_cast<int>(xy.y);
+            term *= (x * 0.5f / k) * (x * 0.5f / k);
+            sum += term;
+        }
+        return sum;
+    }
 
-            return LoadTexelAddressed(x, y, smapler.address);
+    // Weights of the taps at source texels 2x - 2 ... 2x + 3 of destination texel x
+    static std::array<float, TEXTURE_KAISER_FILTER_TAPS> CalculateKaiserWeights()
+    {
+        const float alpha = 4.0f;
+        const float radius = TEXTURE_KAISER_FILTER_TAPS * 0.5f;
+        std::array<float, TEXTURE_KAISER_FILTER_TAPS> weights;
+        float sum = 0.0f;
+        for (uint32 i = 0; i < TEXTURE_KAISER_FILTER_TAPS; i++)
+        {
+            // Distance in source texels from the destination texel center
+            const float d = (float)i + 0.5f - radius;
+            const float x = d * 0.5f * ONE_PI;
+            const float sinc = std::sin(x) / x;
+            const float r = d / radius;
+            const float window = BesselI0(alpha * std::sqrt(1.0f - r * r)) / BesselI0(alpha);
+            weights[i] = sinc * window;
+            sum += weights[i];
+        }
+        for (float& weight : weights)
+        {
+            weight /= sum;
+        }
+        return weights;
+    }
+
+    struct MipGenerationJobData
+    {
+        Texture* texture;
+        uint32 mipLevel;
+        uint32 firstRow;
+        uint32 numRows;
+        MipFilter filter;
+    };
+
+    static void ExecuteMipGeneration(MipGenerationJobData* data)
+    {
+        static const std::array<float, TEXTURE_KAISER_FILTER_TAPS> kaiserWeights = CalculateKaiserWeights();
+        // Filtering happens on decoded values, linear for sRGB formats
+        Texture* texture = data->texture;
+        const uint32 sourceLevel = data->mipLevel - 1;
+        const int maxX = (int)texture->GetWidth(sourceLevel) - 1;
+        const int maxY = (int)texture->GetHeight(sourceLevel) - 1;
+        const uint32 width = texture->GetWidth(data->mipLevel);
+        for (uint32 y = data->firstRow; y < data->firstRow + data->numRows; y++)
+        {
+            for (uint32 x = 0; x < width; x++)
+            {
+                Vector4 result = Vector4(0.0f);
+                switch (data->filter)
+                {
+                case MIP_FILTER_BOX:
+                {
+                    // Odd source sizes repeat their last row or column
+                    const int x0 = std::min(2 * (int)x, maxX);
+                    const int y0 = std::min(2 * (int)y, maxY);
+                    const int x1 = std::min(x0 + 1, maxX);
+                    const int y1 = std::min(y0 + 1, maxY);
+                    result = (texture->LoadTexel(x0, y0, sourceLevel) + texture->LoadTexel(x1, y0, sourceLevel) +
+                              texture->LoadTexel(x0, y1, sourceLevel) + texture->LoadTexel(x1, y1, sourceLevel)) * 0.25f;
+                } break;
+                case MIP_FILTER_KAISER:
+                {
+                    const int firstTap = 1 - TEXTURE_KAISER_FILTER_TAPS / 2;
+                    for (uint32 j = 0; j < TEXTURE_KAISER_FILTER_TAPS; j++)
+                    {
+                        const int sy = glm::clamp(2 * (int)y + firstTap + (int)j, 0, maxY);
+                        Vector4 row = Vector4(0.0f);
+                        for (uint32 i = 0; i < TEXTURE_KAISER_FILTER_TAPS; i++)
+                        {
+                            const int sx = glm::clamp(2 * (int)x + firstTap + (int)i, 0, maxX);
+                            row += texture->LoadTexel(sx, sy, sourceLevel) * kaiserWeights[i];
+                        }
+                        result += row * kaiserWeights[j];
+                    }
+                } break;
+                default: break;
+                }
+                texture->StoreTexel(x, y, result, data->mipLevel);
+            }
+        }
+    }
+
+    void Texture::GenerateMips(MipFilter filter)
+    {
+        ASSERT(!IsBlockCompressedFormat(format));
+        const uint32 numMipLevels = Math::MaxMipLevelCount(width, height);
+        AllocateMips(numMipLevels);
+
+        // Each level is filtered from the previous one, the rows of a level in parallel
+        std::vector<MipGenerationJobData> jobData;
+        std::vector<JobDecl> jobDecls;
+        for (uint32 mipLevel = 1; mipLevel < numMipLevels; mipLevel++)
+        {
+            const MipLevel& mip = mips[mipLevel];
+            const uint32 numJobs = (mip.height + TEXTURE_MIP_GENERATION_ROWS_PER_JOB - 1) / TEXTURE_MIP_GENERATION_ROWS_PER_JOB;
+            jobData.resize(numJobs);
+            jobDecls.resize(numJobs);
+            for (uint32 jobIndex = 0; jobIndex < numJobs; jobIndex++)
+            {
+                const uint32 firstRow = jobIndex * TEXTURE_MIP_GENERATION_ROWS_PER_JOB;
+                jobData[jobIndex] = {
+                    this,
+                    mipLevel,
+                    firstRow,
+                    std::min((uint32)TEXTURE_MIP_GENERATION_ROWS_PER_JOB, mip.height - firstRow),
+                    filter
+                };
+                jobDecls[jobIndex] = {
+                    JOB_SYSTEM_JOB_ENTRY_POINT(ExecuteMipGeneration),
+                    &jobData[jobIndex]
+                };
+            }
+            JobSystemAtomicCounterHandle mipGenerationJobCounter = JobSystem::RunJobs(jobDecls.data(), numJobs);
+            JobSystem::WaitForCounterAndFreeWithoutFiber(mipGenerationJobCounter);
         }
-        Vector2 xy = uv * Vector2(width, height) - Vector2(0.5f);
-        auto x = (int)xy.x;
-        auto y = (int)xy.y;
+    }
+
+    struct CompressionJobData
+    {
+        // Texels of the level as tightly packed RGBA8 rows
+        const uint8* source;
+        uint32 width;
+        uint32 height;
+        uint8* destination;
+        uint32 numBlocksX;
+        uint32 firstBlockRow;
+        uint32 numBlockRows;
+        TextureFormat format;
+    };
 
-        Vector4 texel0 = LoadTexelAddressed(x + 0, y + 0, smapler.address);
-        Vector4 texel1 = LoadTexelAddressed(x + 1, y + 0, smapler.address);
-        Vector4 texel2 = LoadTexelAddressed(x + 0, y + 1, smapler.address);
-        Vector4 texel3 = LoadTexelAddressed(x + 1, y + 1, smapler.address);
+    static void ExecuteCompression(CompressionJobData* data)
+    {
+        const uint32 blockSize = GetTextureFormatSize(data->format);
+        for (uint32 by = data->firstBlockRow; by < data->firstBlockRow + data->numBlockRows; by++)
+        {
+            for (uint32 bx = 0; bx < data->numBlocksX; bx++)
+            {
+                // Partial blocks repeat the last row or column
+                uint8 texels[TEXTURE_COMPRESSION_BLOCK_TEXELS * 4];
+                for (uint32 y = 0; y < TEXTURE_COMPRESSION_BLOCK_SIZE; y++)
+                {
+                    for (uint32 x = 0; x < TEXTURE_COMPRESSION_BLOCK_SIZE; x++)
+                    {
+                        const uint32 sx = std::min(bx * TEXTURE_COMPRESSION_BLOCK_SIZE + x, data->width - 1);
+                        const uint32 sy = std::min(by * TEXTURE_COMPRESSION_BLOCK_SIZE + y, data->height - 1);
+                        memcpy(&texels[(y * TEXTURE_COMPRESSION_BLOCK_SIZE + x) * 4], &data->source[((size_t)sy * data->width + sx) * 4], 4);
+                    }
+                }
+                uint8* block = &data->destination[((size_t)by * data->numBlocksX + bx) * blockSize];
+                switch (data->format)
+                {
+                case TEXTURE_FORMAT_BC1_UNORM:
+                case TEXTURE_FORMAT_BC1_SRGB:  EncodeBC1Block(texels, block); break;
+                case TEXTURE_FORMAT_BC3_UNORM:
+                case TEXTURE_FORMAT_BC3_SRGB:  EncodeBC3Block(texels, block); break;
+                case TEXTURE_FORMAT_BC4_UNORM: EncodeBC4Block(texels, block); break;
+                case TEXTURE_FORMAT_BC5_UNORM: EncodeBC5Block(texels, block); break;
+                default: break;
+                }
+            }
+        }
+    }
+
+    void Texture::Compress(TextureFormat blockFormat)
+    {
+        ASSERT(format == TEXTURE_FORMAT_RGBA8_UNORM || format == TEXTURE_FORMAT_RGBA8_SRGB);
+        ASSERT(IsBlockCompressedFormat(blockFormat) && IsSRGBFormat(blockFormat) == IsSRGBFormat(format));
+        const uint32 numMipLevels = GetNumMipLevels();
+        Texture compressed;
+        compressed.Resize(width, height, blockFormat, TEXTURE_LAYOUT_TILED, numMipLevels);
+
+        // Levels are gathered to rows first, in either layout, and compressed in parallel
+        std::vector<uint8> sourceTexels;
+        std::vector<CompressionJobData> jobData;
+        std::vector<JobDecl> jobDecls;
+        for (uint32 mipLevel = 0; mipLevel < numMipLevels; mipLevel++)
+        {
+            sourceTexels.resize(sourceTexels.size() + (size_t)mips[mipLevel].width * mips[mipLevel].height * 4);
+        }
+        size_t sourceOffset = 0;
+        for (uint32 mipLevel = 0; mipLevel < numMipLevels; mipLevel++)
+        {
+            const MipLevel& mip = mips[mipLevel];
+            uint8* source = &sourceTexels[sourceOffset];
+            for (uint32 y = 0; y < mip.height; y++)
+            {
+                for (uint32 x = 0; x < mip.width; x++)
+                {
+                    memcpy(&source[((size_t)y * mip.width + x) * 4], &buffer[(size_t)GetTexelIndex(mip, x, y) * 4], 4);
+                }
+            }
+            sourceOffset += (size_t)mip.width * mip.height * 4;
+
+            const MipLevel& destination = compressed.mips[mipLevel];
+            const uint32 numBlocksY = (mip.height + TEXTURE_COMPRESSION_BLOCK_SIZE - 1) / TEXTURE_COMPRESSION_BLOCK_SIZE;
+            for (uint32 firstBlockRow = 0; firstBlockRow < numBlocksY; firstBlockRow += TEXTURE_COMPRESSION_BLOCK_ROWS_PER_JOB)
+            {
+                jobData.push_back({
+                    source,
+                    mip.width,
+                    mip.height,
+                    &compressed.buffer[(size_t)destination.offset * compressed.texelSize],
+                    destination.numTilesX,
+                    firstBlockRow,
+                    std::min((uint32)TEXTURE_COMPRESSION_BLOCK_ROWS_PER_JOB, numBlocksY - firstBlockRow),
+                    blockFormat
+                });
+            }
+        }
+        jobDecls.resize(jobData.size());
+        for (uint32 jobIndex = 0; jobIndex < (uint32)jobData.size(); jobIndex++)
+        {
+            jobDecls[jobIndex] = {
+                JOB_SYSTEM_JOB_ENTRY_POINT(ExecuteCompression),
+                &jobData[jobIndex]
+            };
+        }
+        JobSystemAtomicCounterHandle compressionJobCounter = JobSystem::RunJobs(jobDecls.data(), (uint32)jobDecls.size());
+        JobSystem::WaitForCounterAndFreeWithoutFiber(compressionJobCounter);
 
-        xy = glm::fract(xy);
-        return glm::mix(glm::mix(texel0, texel1, xy.x), glm::mix(texel2, texel3, xy.x), xy.y);
+        *this = std::move(compressed);
     }
 }
\ No newline at end of file
@@ -3,11 +3,9 @@
 #include "SRCommon.h"
 #include "SRMath.h"
 
-#define COORD_MOD(i, n) ((i) & ((n) - 1) + (n)) & ((n) - 1)
-#define COORD_MIRROR(i) (i) >= 0 ? (i) : (-1 - (i))
-
-#define SAMPLER_LINEAR_WARP  SamplerState(TEXTURE_FILTER_LINEAR, TEXTURE_ADDRESS_WARP)
-#define SAMPLER_LINEAR_CLAMP SamplerState(TEXTURE_FILTER_LINEAR, TEXTURE_ADDRESS_CLAMP)
+#define SAMPLER_LINEAR_WARP  ImmutableSampler<TEXTURE_FILTER_LINEAR, TEXTURE_ADDRESS_WARP>()
+#define SAMPLER_LINEAR_CLAMP ImmutableSampler<TEXTURE_FILTER_LINEAR, TEXTURE_ADDRESS_CLAMP>()
+#define SAMPLER_TRILINEAR_WARP ImmutableSampler<TEXTURE_FILTER_TRILINEAR, TEXTURE_ADDRESS_WARP>()
 
 namespace SR
 {
@@ -18,12 +16,73 @@ namespace SR
         TEXTURE_ADDRESS_CLAMP,
     };
 
+    // NEAREST and LINEAR read the nearest mip level, TRILINEAR blends the two nearest levels
     enum FilterMode 
     {
         TEXTURE_FILTER_NEAREST,
         TEXTURE_FILTER_LINEAR,
+        TEXTURE_FILTER_TRILINEAR,
+    };
+
+    enum MipFilter
+    {
+        // 2x2 average
+        MIP_FILTER_BOX,
+        // 6x6 Kaiser-windowed sinc, sharper minification. Its negative lobes can overshoot, which
+        // normalized formats saturate.
+        MIP_FILTER_KAISER,
+    };
+
+    enum TextureFormat
+    {
+        TEXTURE_FORMAT_R8_UNORM,
+        TEXTURE_FORMAT_RG8_UNORM,
+        TEXTURE_FORMAT_RGBA8_UNORM,
+        // RGB are sRGB encoded and decoded to linear by loads and samples, filtering happens in linear
+        TEXTURE_FORMAT_RGBA8_SRGB,
+        TEXTURE_FORMAT_RGBA16_FLOAT,
+        TEXTURE_FORMAT_R32_FLOAT,
+        TEXTURE_FORMAT_RGBA32_FLOAT,
+        // Block-compressed, 4x4 texel blocks are decoded on demand through a per-thread cache of decoded blocks
+        TEXTURE_FORMAT_BC1_UNORM,
+        TEXTURE_FORMAT_BC1_SRGB,
+        TEXTURE_FORMAT_BC3_UNORM,
+        TEXTURE_FORMAT_BC3_SRGB,
+        TEXTURE_FORMAT_BC4_UNORM,
+        TEXTURE_FORMAT_BC5_UNORM,
+        TEXTURE_FORMAT_BC7_UNORM,
+        TEXTURE_FORMAT_BC7_SRGB,
+    };
+
+    // Bytes per texel, or per block of block-compressed formats
+    extern uint32 GetTextureFormatSize(TextureFormat format);
+
+    FORCEINLINE constexpr bool IsBlockCompressedFormat(TextureFormat format)
+    {
+        return format >= TEXTURE_FORMAT_BC1_UNORM;
+    }
+
+    enum TextureLayout
+    {
+        // Row-major
+        TEXTURE_LAYOUT_LINEAR,
+        // Row-major TEXTURE_TILE_SIZE x TEXTURE_TILE_SIZE tiles with Morton ordered texels, so a
+        // bilinear footprint or a rotated gradient stays within one or two cache lines
+        TEXTURE_LAYOUT_TILED,
+    };
+
+    enum
+    {
+        TEXTURE_TILE_SIZE = 4,
+        // Lanes of the batched sampling functions, a 2x2 pixel quad
+        TEXTURE_QUAD_SIZE = 4,
     };
 
+    FORCEINLINE bool IsSRGBFormat(TextureFormat format)
+    {
+        return format == TEXTURE_FORMAT_RGBA8_SRGB || format == TEXTURE_FORMAT_BC1_SRGB || format == TEXTURE_FORMAT_BC3_SRGB || format == TEXTURE_FORMAT_BC7_SRGB;
+    }
+
     struct SamplerState
     {
         SamplerState() = default;
@@ -35,46 +94,196 @@ namespace SR
         }
         TextureAddressMode address;
         FilterMode filter;
+        // Added to the LOD computed from derivatives
+        float mipLodBias = 0.0f;
+    };
+
+    // Sampler state fixed at compile time, sampling with one runs code specialized for its filter and
+    // address mode. Sampling with a SamplerState resolves it to one of these once per call.
+    template <FilterMode Filter, TextureAddressMode Address>
+    struct ImmutableSampler
+    {
+        static constexpr FilterMode filter = Filter;
+        static constexpr TextureAddressMode address = Address;
+        operator SamplerState() const
+        {
+            return SamplerState(Filter, Address);
+        }
     };
 
+    template <TextureAddressMode Address, typename Func>
+    FORCEINLINE auto DispatchSamplerFilter(FilterMode filter, Func& func)
+    {
+        switch (filter)
+        {
+        case TEXTURE_FILTER_NEAREST:   return func(ImmutableSampler<TEXTURE_FILTER_NEAREST, Address>());
+        case TEXTURE_FILTER_LINEAR:    return func(ImmutableSampler<TEXTURE_FILTER_LINEAR, Address>());
+        default:                       return func(ImmutableSampler<TEXTURE_FILTER_TRILINEAR, Address>());
+        }
+    }
+
+    // Calls func with the ImmutableSampler of the filter and address mode of sampler, mipLodBias is not carried over
+    template <typename Func>
+    FORCEINLINE auto DispatchSamplerState(const SamplerState& sampler, Func&& func)
+    {
+        switch (sampler.address)
+        {
+        case TEXTURE_ADDRESS_MIRROR:   return DispatchSamplerFilter<TEXTURE_ADDRESS_MIRROR>(sampler.filter, func);
+        case TEXTURE_ADDRESS_CLAMP:    return DispatchSamplerFilter<TEXTURE_ADDRESS_CLAMP>(sampler.filter, func);
+        default:                       return DispatchSamplerFilter<TEXTURE_ADDRESS_WARP>(sampler.filter, func);
+        }
+    }
+
+    // Wraps an integral texel coordinate into [0, size). Power-of-two sizes are masked, other sizes divided by a
+    // multiplication with the reciprocal of size, whose rounding can leave the remainder off by one period.
+    template <bool PowerOfTwo>
+    FORCEINLINE int WrapTexelCoord(int i, int size, float sizeReciprocal)
+    {
+        if constexpr (PowerOfTwo)
+        {
+            return i & (size - 1);
+        }
+        else
+        {
+            int r = i - (int)((float)i * sizeReciprocal) * size;
+            r += r < 0 ? size : 0;
+            r -= r >= size ? size : 0;
+            return r;
+        }
+    }
+
+    template <TextureAddressMode Address, bool PowerOfTwo>
+    FORCEINLINE int AddressTexelCoord(int i, int size, float sizeReciprocal)
+    {
+        if constexpr (Address == TEXTURE_ADDRESS_WARP)
+        {
+            return WrapTexelCoord<PowerOfTwo>(i, size, sizeReciprocal);
+        }
+        else if constexpr (Address == TEXTURE_ADDRESS_MIRROR)
+        {
+            // The second half of each period of 2 * size is reflected
+            const int m = WrapTexelCoord<PowerOfTwo>(i, 2 * size, 0.5f * sizeReciprocal);
+            return m < size ? m : 2 * size - 1 - m;
+        }
+        else
+        {
+            return std::min(std::max(i, 0), size - 1);
+        }
+    }
+
     class Texture
     {
     public:
-        Texture() : width(0), height(0) {}
-        void Resize(uint32 w, uint32 h)
+        Texture() : width(0), height(0), format(TEXTURE_FORMAT_RGBA32_FLOAT), layout(TEXTURE_LAYOUT_LINEAR), texelSize(16), powerOfTwo(false), blockCacheID(0), mips(1, { 0, 0, 0, 0, 0.0f, 0.0f }) {}
+        // Allocates numMipLevels levels, 1 drops the mip chain and GenerateMips rebuilds it from level 0.
+        // Block-compressed formats are always TEXTURE_LAYOUT_TILED, a tile being a block.
+        void Resize(uint32 w, uint32 h, TextureFormat textureFormat = TEXTURE_FORMAT_RGBA32_FLOAT, TextureLayout textureLayout = TEXTURE_LAYOUT_LINEAR, uint32 numMipLevels = 1);
+        TextureFormat GetFormat() const
         {
-            width = w;
-            height = h;
-            buffer.resize(w * h);
+            return format;
         }
-        uint32 GetWidth() const
+        TextureLayout GetLayout() const
         {
-            return width;
+            return layout;
         }
-        uint32 GetHeight() const
+        uint32 GetWidth(uint32 mipLevel = 0) const
         {
-            return height;
+            return mips[mipLevel].width;
         }
-        Vector4 Sample(const SamplerState& smapler, const Vector2& uv)  const;
-        Vector4 LoadTexelAddressed(int x, int y, TextureAddressMode address) const;
-        Vector4 LoadTexel(uint32 x, uint32 y) const
+        uint32 GetHeight(uint32 mipLevel = 0) const
         {
-            if (x >= width || y >= height)
-            {
-                return Vector4(0.0f);
-            }
-            uint32 index = y * width + x;
-            return buffer[index];
+            return mips[mipLevel].height;
         }
-        void StoreTexel(uint32 x, uint32 y, const Vector4& value)
+        uint32 GetNumMipLevels() const
         {
-            uint32 index = y * width + x;
-            buffer[index] = value;
+            return (uint32)mips.size();
         }
+        // Down to Math::MaxMipLevelCount levels, each filtered from the previous one on the job system.
+        // Not supported by block-compressed formats, their mips are compressed from an uncompressed chain.
+        void GenerateMips(MipFilter filter);
+        // Converts all levels of an RGBA8 texture to BC1, BC3, BC4 or BC5 on the job system, the sRGB-ness of the
+        // two formats must match. BC7 textures are created from precompressed data with SetData.
+        void Compress(TextureFormat blockFormat);
+        // Level 0
+        Vector4 Sample(const SamplerState& smapler, const Vector2& uv)  const;
+        // LOD from the screen-space derivatives of uv, plus smapler.mipLodBias
+        Vector4 SampleGrad(const SamplerState& smapler, const Vector2& uv, const Vector2& ddx, const Vector2& ddy) const;
+        Vector4 SampleLevel(const SamplerState& smapler, const Vector2& uv, float lod) const;
+        float CalculateLevelOfDetail(const SamplerState& smapler, const Vector2& ddx, const Vector2& ddy) const;
+        // Sample the lanes of a pixel quad, which share the LOD of the quad derivatives. Addressing and
+        // weights are computed for all lanes at once and bilinear and trilinear texels blended with SIMD.
+        void SampleGradQuad(const SamplerState& smapler, const Vector2 uv[TEXTURE_QUAD_SIZE], const Vector2& ddx, const Vector2& ddy, Vector4 outTexels[TEXTURE_QUAD_SIZE]) const;
+        void SampleLevelQuad(const SamplerState& smapler, const Vector2 uv[TEXTURE_QUAD_SIZE], float lod, Vector4 outTexels[TEXTURE_QUAD_SIZE]) const;
+        // The same with an immutable sampler, instantiated for every filter and address mode
+        template <FilterMode Filter, TextureAddressMode Address>
+        Vector4 Sample(ImmutableSampler<Filter, Address> sampler, const Vector2& uv) const;
+        template <FilterMode Filter, TextureAddressMode Address>
+        Vector4 SampleGrad(ImmutableSampler<Filter, Address> sampler, const Vector2& uv, const Vector2& ddx, const Vector2& ddy) const;
+        template <FilterMode Filter, TextureAddressMode Address>
+        Vector4 SampleLevel(ImmutableSampler<Filter, Address> sampler, const Vector2& uv, float lod) const;
+        template <FilterMode Filter, TextureAddressMode Address>
+        void SampleGradQuad(ImmutableSampler<Filter, Address> sampler, const Vector2 uv[TEXTURE_QUAD_SIZE], const Vector2& ddx, const Vector2& ddy, Vector4 outTexels[TEXTURE_QUAD_SIZE]) const;
+        template <FilterMode Filter, TextureAddressMode Address>
+        void SampleLevelQuad(ImmutableSampler<Filter, Address> sampler, const Vector2 uv[TEXTURE_QUAD_SIZE], float lod, Vector4 outTexels[TEXTURE_QUAD_SIZE]) const;
+        Vector4 LoadTexelAddressed(int x, int y, TextureAddressMode address, uint32 mipLevel = 0) const;
+        // Texels are converted from and to the format, sRGB formats take linear values.
+        // Stores to block-compressed formats are ignored.
+        Vector4 LoadTexel(uint32 x, uint32 y, uint32 mipLevel = 0) const;
+        void StoreTexel(uint32 x, uint32 y, const Vector4& value, uint32 mipLevel = 0);
+        // Copies a level from tightly packed rows of texels, or of blocks, in the texture format
+        void SetData(const void* data, uint32 mipLevel = 0);
     private:
+        struct MipLevel
+        {
+            uint32 width;
+            uint32 height;
+            // First texel of the level in buffer
+            uint32 offset;
+            // Tiles per row for TEXTURE_LAYOUT_TILED
+            uint32 numTilesX;
+            // For wrapping coordinates of textures that are not a power of two
+            float widthReciprocal;
+            float heightReciprocal;
+        };
+        MipLevel CreateMipLevel(uint32 w, uint32 h, uint32 offset) const;
+        // Texels, or blocks, of a level in buffer, including the padding of partial tiles
+        uint32 GetMipLevelSize(const MipLevel& mip) const;
+        void AllocateMips(uint32 numMipLevels);
+        template <TextureLayout Layout>
+        static uint32 GetTexelIndex(const MipLevel& mip, uint32 x, uint32 y);
+        uint32 GetTexelIndex(const MipLevel& mip, uint32 x, uint32 y) const;
+        template <TextureAddressMode Address>
+        Vector4 LoadTexelAddressed(int x, int y, uint32 mipLevel) const;
+        // Specialized per format, layout, sampler and whether the texture is a power of two, so decoding, addressing
+        // and filtering are inlined into each other
+        template <TextureFormat Format, TextureLayout Layout>
+        Vector4 ReadTexel(const MipLevel& mip, uint32 x, uint32 y) const;
+        template <TextureFormat Format, TextureLayout Layout, TextureAddressMode Address, bool PowerOfTwo>
+        Vector4 FetchTexel(int x, int y, uint32 mipLevel) const;
+        template <TextureFormat Format, TextureLayout Layout, FilterMode Filter, TextureAddressMode Address, bool PowerOfTwo>
+        Vector4 SampleMipLevel(const Vector2& uv, uint32 mipLevel) const;
+        template <TextureFormat Format, TextureLayout Layout, FilterMode Filter, TextureAddressMode Address, bool PowerOfTwo>
+        Vector4 SampleLevel(const Vector2& uv, float lod) const;
+        // Adds the bilinear samples of a level times weight to inOutTexels
+        template <TextureFormat Format, TextureLayout Layout, TextureAddressMode Address, bool PowerOfTwo>
+        void SampleMipLevelQuad(const Vector2 uv[TEXTURE_QUAD_SIZE], uint32 mipLevel, float weight, Vector4 inOutTexels[TEXTURE_QUAD_SIZE]) const;
+        template <TextureFormat Format, TextureLayout Layout, FilterMode Filter, TextureAddressMode Address, bool PowerOfTwo>
+        void SampleLevelQuad(const Vector2 uv[TEXTURE_QUAD_SIZE], float lod, Vector4 outTexels[TEXTURE_QUAD_SIZE]) const;
+        // Decoded RGBA8 texels of a block, from the cache of the calling thread
+        template <TextureFormat Format>
+        const uint8* FetchBlock(uint32 blockIndex) const;
         uint32 width;
         uint32 height;
-        std::vector<Vector4> buffer;
+        TextureFormat format;
+        TextureLayout layout;
+        uint32 texelSize;
+        // Both sizes are powers of two, so are those of all mip levels
+        bool powerOfTwo;
+        // Tags decoded blocks, changes whenever the data does so that stale blocks miss
+        uint32 blockCacheID;
+        // All mip levels, largest first
+        std::vector<uint8> buffer;
+        std::vector<MipLevel> mips;
     };
 
     template <typename T>
@@ -85,7 +294,7 @@ namespace SR
             : width(w)
             , height(h)
         {
-
+            UpdateAddressing();
         }
         uint32 GetWidth() const
         {
@@ -100,6 +309,7 @@ namespace SR
             width = w;
             height = h;
             buffer.resize(width * height);
+            UpdateAddressing();
         }
         void Clear(const T& clearValue)
         {
@@ -108,6 +318,29 @@ namespace SR
                 buffer[i] = clearValue;
             }
         }
+        // Copies numRows rows from firstRow on, so that large copies can be split over jobs, moved by (offsetX,
+        // offsetY) texels: this(x, y) = source(x + offsetX, y + offsetY). Texels from outside source are clearValue.
+        void CopyRows(const RenderTarget<T>& source, uint32 firstRow, uint32 numRows, int32 offsetX, int32 offsetY, const T& clearValue)
+        {
+            ASSERT(source.width == width && source.height == height && firstRow + numRows <= height);
+            // The columns whose source is inside source
+            const int32 firstX = std::clamp(-offsetX, 0, (int32)width);
+            const int32 endX = std::clamp((int32)width - offsetX, firstX, (int32)width);
+            for (uint32 y = firstRow; y < firstRow + numRows; y++)
+            {
+                const auto row = buffer.begin() + y * width;
+                const int32 sourceY = (int32)y + offsetY;
+                if (sourceY < 0 || sourceY >= (int32)height)
+                {
+                    std::fill(row, row + width, clearValue);
+                    continue;
+                }
+                const auto sourceRow = source.buffer.begin() + sourceY * width;
+                std::fill(row, row + firstX, clearValue);
+                std::copy(sourceRow + (firstX + offsetX), sourceRow + (endX + offsetX), row + firstX);
+                std::fill(row + endX, row + width, clearValue);
+            }
+        }
         const T& Load(uint32 x, uint32 y) const
         {
             uint32 index = y * width + x;
@@ -123,72 +356,191 @@ namespace SR
             return buffer.data();
         } 
         T LoadTexelAddressed(int x, int y, TextureAddressMode address) const;
-        T Sample(const SamplerState& smapler, const Vector2& uv) const;
+        template <TextureAddressMode Address>
+        T LoadTexelAddressed(int x, int y) const;
+        // No mip levels, TRILINEAR filters like LINEAR
+        T Sample(const SamplerState& smapler, const Vector2& uv) const
+        {
+            return DispatchSamplerState(smapler, [&](auto sampler) { return Sample(sampler, uv); });
+        }
+        template <FilterMode Filter, TextureAddressMode Address>
+        T Sample(ImmutableSampler<Filter, Address> /*sampler*/, const Vector2& uv) const
+        {
+            return powerOfTwo ? Sample<Filter, Address, true>(uv) : Sample<Filter, Address, false>(uv);
+        }
+        // The 4 texels of the bilinear footprint of uv, in the order of Gather in HLSL: (x0, y1), (x1, y1),
+        // (x1, y0), (x0, y0) with (x0, y0) the top-left texel. The filter of the sampler is ignored.
+        // Scalar texel types only.
+        template <FilterMode Filter, TextureAddressMode Address>
+        glm::vec<4, T> Gather4(ImmutableSampler<Filter, Address> /*sampler*/, const Vector2& uv) const
+        {
+            T texels[4];
+            Vector2 fraction;
+            powerOfTwo ? GatherTexels<Address, true>(uv, texels, fraction) : GatherTexels<Address, false>(uv, texels, fraction);
+            return glm::vec<4, T>(texels[0], texels[1], texels[2], texels[3]);
+        }
+        // Texels pass when compareValue <= texel, the comparison of a COMPARE_OP_LESS_OR_EQUAL depth test. They are
+        // compared before they are filtered, so LINEAR returns the bilinear weight of the texels that pass.
+        template <FilterMode Filter, TextureAddressMode Address>
+        float SampleCmp(ImmutableSampler<Filter, Address> /*sampler*/, const Vector2& uv, float compareValue) const
+        {
+            return powerOfTwo ? SampleCmp<Filter, Address, true>(uv, compareValue) : SampleCmp<Filter, Address, false>(uv, compareValue);
+        }
     private:
+        void UpdateAddressing()
+        {
+            powerOfTwo = Math::IsPowerOfTwo(width) && Math::IsPowerOfTwo(height);
+            widthReciprocal = 1.0f / (float)std::max(width, 1u);
+            heightReciprocal = 1.0f / (float)std::max(height, 1u);
+        }
+        template <TextureAddressMode Address, bool PowerOfTwo>
+        T FetchTexel(int x, int y) const
+        {
+            return Load((uint32)AddressTexelCoord<Address, PowerOfTwo>(x, (int)width, widthReciprocal),
+                        (uint32)AddressTexelCoord<Address, PowerOfTwo>(y, (int)height, heightReciprocal));
+        }
+        template <FilterMode Filter, TextureAddressMode Address, bool PowerOfTwo>
+        T Sample(const Vector2& uv) const;
+        // The footprint in the order of Gather4, and the position of uv between the texels
+        template <TextureAddressMode Address, bool PowerOfTwo>
+        void GatherTexels(const Vector2& uv, T outTexels[4], Vector2& outFraction) const;
+        template <FilterMode Filter, TextureAddressMode Address, bool PowerOfTwo>
+        float SampleCmp(const Vector2& uv, float compareValue) const;
         uint32 width;
         uint32 height;
+        bool powerOfTwo;
+        float widthReciprocal;
+        float heightReciprocal;
         std::vector<T> buffer;
     };
 
     template <typename T>
     T RenderTarget<T>::LoadTexelAddressed(int x, int y, TextureAddressMode address) const
     {
-        int w = (int)width;
-        int h = (int)height;
         switch (address)
         {
-        case TEXTURE_ADDRESS_WARP:
-        {
-            x = COORD_MOD(x, w);
-            y = COORD_MOD(y, h);
-        } break;
-        case TEXTURE_ADDRESS_MIRROR:
-        {
-            x = COORD_MOD(x, 2 * w);
-            y = COORD_MOD(y, 2 * h);
-
-            x -= w;
-            y -= h;
+        case TEXTURE_ADDRESS_MIRROR:   return LoadTexelAddressed<TEXTURE_ADDRESS_MIRROR>(x, y);
+        case TEXTURE_ADDRESS_CLAMP:    return LoadTexelAddressed<TEXTURE_ADDRESS_CLAMP>(x, y);
+        default:                       return LoadTexelAddressed<TEXTURE_ADDRESS_WARP>(x, y);
+        }
+    }
 
-            x = COORD_MIRROR(x);
-            y = COORD_MIRROR(y);
+    template <typename T>
+    template <TextureAddressMode Address>
+    T RenderTarget<T>::LoadTexelAddressed(int x, int y) const
+    {
+        return powerOfTwo ? FetchTexel<Address, true>(x, y) : FetchTexel<Address, false>(x, y);
+    }
 
-            x = w - 1 - x;
-            y = h - 1 - y;
-        } break;
-        case TEXTURE_ADDRESS_CLAMP:
+    template <typename T>
+    template <FilterMode Filter, TextureAddressMode Address, bool PowerOfTwo>
+    T RenderTarget<T>::Sample(const Vector2& uv) const
+    {
+        if constexpr (Filter == TEXTURE_FILTER_NEAREST)
         {
-            if (x < 0) x = 0;
-            if (y < 0) y = 0;
-            if (x >= w) x = w - 1;
-            if (y >= h) y = h - 1;
-        } break;
-        default: break;
+            Vector2 xy = glm::floor(uv * Vector2(width, height));
+            return FetchTexel<Address, PowerOfTwo>((int)xy.x, (int)xy.y);
+        }
+        else
+        {
+            T texels[4];
+            Vector2 fraction;
+            GatherTexels<Address, PowerOfTwo>(uv, texels, fraction);
+            return glm::mix(glm::mix(texels[3], texels[2], fraction.x), glm::mix(texels[0], texels[1], fraction.x), fraction.y);
         }
-        return Load(x, y);
     }
 
     template <typename T>
-    T RenderTarget<T>::Sample(const SamplerState& smapler, const Vector2& uv) const
+    template <TextureAddressMode Address, bool PowerOfTwo>
+    FORCEINLINE void RenderTarget<T>::GatherTexels(const Vector2& uv, T outTexels[4], Vector2& outFraction) const
     {
-        if (smapler.filter == TEXTURE_FILTER_NEAREST)
-        {
-            Vector2 xy = uv * Vector2(width, height);
-            int x = (int)xy.x;
-            int y = static_cast<int>(xy.y);
+        const Vector2 xy = uv * Vector2(width, height) - Vector2(0.5f);
+        const Vector2 xy0 = glm::floor(xy);
+        outFraction = xy - xy0;
+        const int x = (int)xy0.x;
+        const int y = (int)xy0.y;
+        outTexels[0] = FetchTexel<Address, PowerOfTwo>(x + 0, y + 1);
+        outTexels[1] = FetchTexel<Address, PowerOfTwo>(x + 1, y + 1);
+        outTexels[2] = FetchTexel<Address, PowerOfTwo>(x + 1, y + 0);
+        outTexels[3] = FetchTexel<Address, PowerOfTwo>(x + 0, y + 0);
+    }
 
-            return LoadTexelAddressed(x, y, smapler.address);
+    template <typename T>
+    template <FilterMode Filter, TextureAddressMode Address, bool PowerOfTwo>
+    FORCEINLINE float RenderTarget<T>::SampleCmp(const Vector2& uv, float compareValue) const
+    {
+        if constexpr (Filter == TEXTURE_FILTER_NEAREST)
+        {
+            const Vector2 xy = glm::floor(uv * Vector2(width, height));
+            return compareValue <= FetchTexel<Address, PowerOfTwo>((int)xy.x, (int)xy.y) ? 1.0f : 0.0f;
+        }
+        else
+        {
+            T texels[4];
+            Vector2 fraction;
+            GatherTexels<Address, PowerOfTwo>(uv, texels, fraction);
+            const Vector4 passed = Vector4(glm::lessThanEqual(Vector4(compareValue), Vector4(texels[0], texels[1], texels[2], texels[3])));
+            return glm::mix(glm::mix(passed.w, passed.z, fraction.x), glm::mix(passed.x, passed.y, fraction.x), fraction.y);
         }
-        Vector2 xy = uv * Vector2(width, height) - Vector2(0.5f);
-        auto x = (int)xy.x;
-        auto y = (int)xy.y;
+    }
 
-        T texel0 = LoadTexelAddressed(x + 0, y + 0, smapler.address);
-        T texel1 = LoadTexelAddressed(x + 1, y + 0, smapler.address);
-        T texel2 = LoadTexelAddressed(x + 0, y + 1, smapler.address);
-        T texel3 = LoadTexelAddressed(x + 1, y + 1, smapler.address);
+    enum
+    {
+        HIZ_BLOCK_SIZE = 8,
+    };
 
-        xy = glm::fract(xy);
-        return glm::mix(glm::mix(texel0, texel1, xy.x), glm::mix(texel2, texel3, xy.x), xy.y);
-    }
+    // Conservative min/max depth of each HIZ_BLOCK_SIZE x HIZ_BLOCK_SIZE block of a depth buffer.
+    // The bounds must enclose every depth value of their block, they are allowed to be loose.
+    class HiZBuffer
+    {
+    public:
+        HiZBuffer(uint32 w, uint32 h)
+        {
+            Resize(w, h);
+        }
+        uint32 GetNumBlocksX() const
+        {
+            return numBlocksX;
+        }
+        uint32 GetNumBlocksY() const
+        {
+            return numBlocksY;
+        }
+        // Size of the depth buffer in pixels
+        void Resize(uint32 w, uint32 h)
+        {
+            numBlocksX = (w + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE;
+            numBlocksY = (h + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE;
+            minDepth.resize(numBlocksX * numBlocksY);
+            maxDepth.resize(numBlocksX * numBlocksY);
+        }
+        // Must be cleared together with the depth buffer, to the same value
+        void Clear(float clearValue)
+        {
+            for (uint32 i = 0; i < numBlocksX * numBlocksY; i++)
+            {
+                minDepth[i] = clearValue;
+                maxDepth[i] = clearValue;
+            }
+        }
+        float LoadMinDepth(uint32 blockX, uint32 blockY) const
+        {
+            return minDepth[blockY * numBlocksX + blockX];
+        }
+        float LoadMaxDepth(uint32 blockX, uint32 blockY) const
+        {
+            return maxDepth[blockY * numBlocksX + blockX];
+        }
+        void Store(uint32 blockX, uint32 blockY, float blockMinDepth, float blockMaxDepth)
+        {
+            uint32 index = blockY * numBlocksX + blockX;
+            minDepth[index] = blockMinDepth;
+            maxDepth[index] = blockMaxDepth;
+        }
+    private:
+        uint32 numBlocksX;
+        uint32 numBlocksY;
+        std::vector<float> minDepth;
+        std::vector<float> maxDepth;
+    };
 }
\ No newline at end of file
@@ -0,0 +1,536 @@
+#include "TextureCompression.h"
+#include "SRMath.h"
+
+namespace SR
+{
+    // Subset of each texel of the 2 subset partitions, one bit per texel
+    static const uint16 bc7Partitions2[64] = {
+        0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+        0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+        0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+        0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+        0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+        0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+        0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+        0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22,
+    };
+
+    // Subset of each texel of the 3 subset partitions, two bits per texel
+    static const uint32 bc7Partitions3[64] = {
+        0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+        0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+        0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+        0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+        0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+        0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+        0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+        0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254,
+    };
+
+    // Texels whose index has one bit less, besides texel 0, which anchors subset 0
+    static const uint8 bc7AnchorIndices2[64] = {
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+        15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+         6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+    };
+
+    static const uint8 bc7AnchorIndices3Subset1[64] = {
+         3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+         3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+         8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+         3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+    };
+
+    static const uint8 bc7AnchorIndices3Subset2[64] = {
+        15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+        15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+        15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+        15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+    };
+
+    static const uint8 bc7Weights2[4] = { 0, 21, 43, 64 };
+    static const uint8 bc7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+    static const uint8 bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    struct BC7Mode
+    {
+        uint8 numSubsets;
+        uint8 partitionBits;
+        uint8 rotationBits;
+        uint8 indexSelectionBits;
+        uint8 colorBits;
+        uint8 alphaBits;
+        // One P-bit per endpoint, or one shared by the two endpoints of a subset
+        uint8 endpointPBits;
+        uint8 sharedPBits;
+        uint8 indexBits;
+        uint8 secondaryIndexBits;
+    };
+
+    static const BC7Mode bc7Modes[8] = {
+        { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+        { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+        { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+        { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+        { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+        { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+        { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+        { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+    };
+
+    // Reads the 128 bits of a block from the least significant bit up
+    class BlockBitReader
+    {
+    public:
+        BlockBitReader(const uint8* block) : position(0)
+        {
+            memcpy(&bits[0], block, sizeof(bits));
+        }
+        uint32 Read(uint32 numBits)
+        {
+            if (numBits == 0)
+            {
+                return 0;
+            }
+            uint64 value;
+            if (position >= 64)
+            {
+                value = bits[1] >> (position - 64);
+            }
+            else
+            {
+                value = bits[0] >> position;
+                if (position > 0)
+                {
+                    value |= bits[1] << (64 - position);
+                }
+            }
+            position += numBits;
+            return (uint32)(value & ((1ull << numBits) - 1));
+        }
+    private:
+        uint64 bits[2];
+        uint32 position;
+    };
+
+    FORCEINLINE static uint16 LoadUint16(const uint8* data)
+    {
+        return (uint16)(data[0] | (data[1] << 8));
+    }
+
+    FORCEINLINE static void StoreUint16(uint16 value, uint8* data)
+    {
+        data[0] = (uint8)value;
+        data[1] = (uint8)(value >> 8);
+    }
+
+    static void Expand565(uint16 color, uint8* rgb)
+    {
+        const uint32 r = (color >> 11) & 31;
+        const uint32 g = (color >> 5) & 63;
+        const uint32 b = color & 31;
+        rgb[0] = (uint8)((r << 3) | (r >> 2));
+        rgb[1] = (uint8)((g << 2) | (g >> 4));
+        rgb[2] = (uint8)((b << 3) | (b >> 2));
+    }
+
+    static uint16 Quantize565(const uint8* rgb)
+    {
+        const uint32 r = (rgb[0] * 31 + 127) / 255;
+        const uint32 g = (rgb[1] * 63 + 127) / 255;
+        const uint32 b = (rgb[2] * 31 + 127) / 255;
+        return (uint16)((r << 11) | (g << 5) | b);
+    }
+
+    // The 4 colors of a BC1 color block. With color0 <= color1 in BC1 the block has 3 colors and transparent black,
+    // the color blocks of BC3 always have 4 colors.
+    static void CalculateBC1Palette(uint16 color0, uint16 color1, bool allowTransparent, uint8 palette[4][4])
+    {
+        Expand565(color0, palette[0]);
+        Expand565(color1, palette[1]);
+        palette[0][3] = 255;
+        palette[1][3] = 255;
+        palette[2][3] = 255;
+        palette[3][3] = 255;
+        if (color0 > color1 || !allowTransparent)
+        {
+            for (uint32 c = 0; c < 3; c++)
+            {
+                palette[2][c] = (uint8)((2 * palette[0][c] + palette[1][c] + 1) / 3);
+                palette[3][c] = (uint8)((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+            }
+        }
+        else
+        {
+            for (uint32 c = 0; c < 3; c++)
+            {
+                palette[2][c] = (uint8)((palette[0][c] + palette[1][c] + 1) / 2);
+                palette[3][c] = 0;
+            }
+            palette[3][3] = 0;
+        }
+    }
+
+    // The 8 values of a BC4 block, 6 interpolated when value0 > value1, else 4 interpolated plus 0 and 255
+    static void CalculateBC4Palette(uint8 value0, uint8 value1, uint8 palette[8])
+    {
+        palette[0] = value0;
+        palette[1] = value1;
+        if (value0 > value1)
+        {
+            for (uint32 i = 1; i < 7; i++)
+            {
+                palette[i + 1] = (uint8)(((7 - i) * value0 + i * value1 + 3) / 7);
+            }
+        }
+        else
+        {
+            for (uint32 i = 1; i < 5; i++)
+            {
+                palette[i + 1] = (uint8)(((5 - i) * value0 + i * value1 + 2) / 5);
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    static void DecodeBC1ColorBlock(const uint8* block, bool allowTransparent, uint8* texels)
+    {
+        uint8 palette[4][4];
+        CalculateBC1Palette(LoadUint16(block), LoadUint16(block + 2), allowTransparent, palette);
+        uint32 indices;
+        memcpy(&indices, block + 4, sizeof(indices));
+        for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+        {
+            memcpy(texels + i * 4, palette[(indices >> (2 * i)) & 3], 4);
+        }
+    }
+
+    // Decodes one channel, the texels are 4 bytes apart
+    static void DecodeBC4Channel(const uint8* block, uint8* texels)
+    {
+        uint8 palette[8];
+        CalculateBC4Palette(block[0], block[1], palette);
+        uint64 indices = 0;
+        memcpy(&indices, block + 2, 6);
+        for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+        {
+            texels[i * 4] = palette[(indices >> (3 * i)) & 7];
+        }
+    }
+
+    void DecodeBC1Block(const uint8* block, uint8* texels)
+    {
+        DecodeBC1ColorBlock(block, true, texels);
+    }
+
+    void DecodeBC3Block(const uint8* block, uint8* texels)
+    {
+        DecodeBC1ColorBlock(block + 8, false, texels);
+        DecodeBC4Channel(block, texels + 3);
+    }
+
+    void DecodeBC4Block(const uint8* block, uint8* texels)
+    {
+        for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+        {
+            texels[i * 4 + 1] = 0;
+            texels[i * 4 + 2] = 0;
+            texels[i * 4 + 3] = 255;
+        }
+        DecodeBC4Channel(block, texels);
+    }
+
+    void DecodeBC5Block(const uint8* block, uint8* texels)
+    {
+        for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+        {
+            texels[i * 4 + 2] = 0;
+            texels[i * 4 + 3] = 255;
+        }
+        DecodeBC4Channel(block, texels);
+        DecodeBC4Channel(block + 8, texels + 1);
+    }
+
+    FORCEINLINE static uint32 GetBC7Subset(uint32 numSubsets, uint32 partition, uint32 texel)
+    {
+        switch (numSubsets)
+        {
+        case 2:  return (bc7Partitions2[partition] >> texel) & 1;
+        case 3:  return (bc7Partitions3[partition] >> (2 * texel)) & 3;
+        default: return 0;
+        }
+    }
+
+    FORCEINLINE static bool IsBC7AnchorIndex(uint32 numSubsets, uint32 partition, uint32 texel)
+    {
+        switch (numSubsets)
+        {
+        case 2:  return texel == 0 || texel == bc7AnchorIndices2[partition];
+        case 3:  return texel == 0 || texel == bc7AnchorIndices3Subset1[partition] || texel == bc7AnchorIndices3Subset2[partition];
+        default: return texel == 0;
+        }
+    }
+
+    FORCEINLINE static uint8 InterpolateBC7(uint32 endpoint0, uint32 endpoint1, uint32 indexBits, uint32 index)
+    {
+        const uint32 weight = indexBits == 2 ? bc7Weights2[index] : (indexBits == 3 ? bc7Weights3[index] : bc7Weights4[index]);
+        return (uint8)(((64 - weight) * endpoint0 + weight * endpoint1 + 32) >> 6);
+    }
+
+    // Scales a value of numBits bits to 8 bits by replicating its high bits
+    FORCEINLINE static uint8 UnquantizeBC7(uint32 value, uint32 numBits)
+    {
+        value <<= 8 - numBits;
+        return (uint8)(value | (value >> numBits));
+    }
+
+    void DecodeBC7Block(const uint8* block, uint8* texels)
+    {
+        BlockBitReader reader(block);
+        uint32 modeIndex = 0;
+        while (modeIndex < 8 && reader.Read(1) == 0)
+        {
+            modeIndex++;
+        }
+        if (modeIndex == 8)
+        {
+            // Reserved mode
+            memset(texels, 0, TEXTURE_COMPRESSION_BLOCK_TEXELS * 4);
+            return;
+        }
+        const BC7Mode& mode = bc7Modes[modeIndex];
+        const uint32 partition = reader.Read(mode.partitionBits);
+        const uint32 rotation = reader.Read(mode.rotationBits);
+        const uint32 indexSelection = reader.Read(mode.indexSelectionBits);
+
+        // Endpoints are stored channel by channel, then subset by subset
+        uint32 endpoints[3][2][4] = {};
+        for (uint32 c = 0; c < 3; c++)
+        {
+            for (uint32 s = 0; s < mode.numSubsets; s++)
+            {
+                endpoints[s][0][c] = reader.Read(mode.colorBits);
+                endpoints[s][1][c] = reader.Read(mode.colorBits);
+            }
+        }
+        for (uint32 s = 0; s < mode.numSubsets; s++)
+        {
+            endpoints[s][0][3] = reader.Read(mode.alphaBits);
+            endpoints[s][1][3] = reader.Read(mode.alphaBits);
+        }
+        const uint32 numPBits = mode.endpointPBits | mode.sharedPBits;
+        uint32 pBits[3][2] = {};
+        for (uint32 s = 0; s < mode.numSubsets; s++)
+        {
+            pBits[s][0] = reader.Read(numPBits);
+            pBits[s][1] = mode.sharedPBits ? pBits[s][0] : reader.Read(numPBits);
+        }
+        for (uint32 s = 0; s < mode.numSubsets; s++)
+        {
+            for (uint32 e = 0; e < 2; e++)
+            {
+                for (uint32 c = 0; c < 3; c++)
+                {
+                    endpoints[s][e][c] = UnquantizeBC7((endpoints[s][e][c] << numPBits) | pBits[s][e], mode.colorBits + numPBits);
+                }
+                endpoints[s][e][3] = mode.alphaBits ? UnquantizeBC7((endpoints[s][e][3] << numPBits) | pBits[s][e], mode.alphaBits + numPBits) : 255;
+            }
+        }
+
+        uint32 indices[TEXTURE_COMPRESSION_BLOCK_TEXELS];
+        uint32 secondaryIndices[TEXTURE_COMPRESSION_BLOCK_TEXELS] = {};
+        for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+        {
+            indices[i] = reader.Read(mode.indexBits - (IsBC7AnchorIndex(mode.numSubsets, partition, i) ? 1 : 0));
+        }
+        if (mode.secondaryIndexBits)
+        {
+            for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+            {
+                secondaryIndices[i] = reader.Read(mode.secondaryIndexBits - (i == 0 ? 1 : 0));
+            }
+        }
+
+        for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+        {
+            const uint32 (&endpoint)[2][4] = endpoints[GetBC7Subset(mode.numSubsets, partition, i)];
+            uint8* texel = texels + i * 4;
+            // Modes 4 and 5 index color and alpha separately, the index selection bit swaps the two index sets of mode 4
+            uint32 colorIndex = indices[i];
+            uint32 colorIndexBits = mode.indexBits;
+            uint32 alphaIndex = indices[i];
+            uint32 alphaIndexBits = mode.indexBits;
+            if (mode.secondaryIndexBits)
+            {
+                alphaIndex = secondaryIndices[i];
+                alphaIndexBits = mode.secondaryIndexBits;
+                if (indexSelection)
+                {
+                    std::swap(colorIndex, alphaIndex);
+                    std::swap(colorIndexBits, alphaIndexBits);
+                }
+            }
+            for (uint32 c = 0; c < 3; c++)
+            {
+                texel[c] = InterpolateBC7(endpoint[0][c], endpoint[1][c], colorIndexBits, colorIndex);
+            }
+            texel[3] = InterpolateBC7(endpoint[0][3], endpoint[1][3], alphaIndexBits, alphaIndex);
+            // Rotation swaps alpha with red, green or blue
+            if (rotation)
+            {
+                std::swap(texel[3], texel[rotation - 1]);
+            }
+        }
+    }
+
+    // Endpoints at the extremes of the block colors projected on their principal axis, found by power iteration
+    static void FitBC1Endpoints(const uint8* texels, uint16& color0, uint16& color1)
+    {
+        Vector3 mean = Vector3(0.0f);
+        for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+        {
+            mean += Vector3(texels[i * 4 + 0], texels[i * 4 + 1], texels[i * 4 + 2]);
+        }
+        mean /= (float)TEXTURE_COMPRESSION_BLOCK_TEXELS;
+        Matrix3x3 covariance = Matrix3x3(0.0f);
+        for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+        {
+            const Vector3 d = Vector3(texels[i * 4 + 0], texels[i * 4 + 1], texels[i * 4 + 2]) - mean;
+            covariance += glm::outerProduct(d, d);
+        }
+        Vector3 axis = Vector3(1.0f);
+        for (uint32 iteration = 0; iteration < 8; iteration++)
+        {
+            axis = covariance * axis;
+            const float maxComponent = std::max(std::abs(axis.x), std::max(std::abs(axis.y), std::abs(axis.z)));
+            if (maxComponent == 0.0f)
+            {
+                // Solid block
+                axis = Vector3(1.0f);
+                break;
+            }
+            axis /= maxComponent;
+        }
+        uint32 minTexel = 0;
+        uint32 maxTexel = 0;
+        float minProjection = FLT_MAX;
+        float maxProjection = -FLT_MAX;
+        for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+        {
+            const float projection = glm::dot(Vector3(texels[i * 4 + 0], texels[i * 4 + 1], texels[i * 4 + 2]), axis);
+            if (projection < minProjection)
+            {
+                minProjection = projection;
+                minTexel = i;
+            }
+            if (projection > maxProjection)
+            {
+                maxProjection = projection;
+                maxTexel = i;
+            }
+        }
+        color0 = Quantize565(texels + maxTexel * 4);
+        color1 = Quantize565(texels + minTexel * 4);
+        // 4 color mode
+        if (color0 < color1)
+        {
+            std::swap(color0, color1);
+        }
+    }
+
+    static void EncodeBC1ColorBlock(const uint8* texels, uint8* block)
+    {
+        uint16 color0;
+        uint16 color1;
+        FitBC1Endpoints(texels, color0, color1);
+        uint8 palette[4][4];
+        CalculateBC1Palette(color0, color1, false, palette);
+        uint32 indices = 0;
+        // Equal endpoints are the 3 color mode in BC1, index 0 is the same color in both modes
+        if (color0 != color1)
+        {
+            for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+            {
+                uint32 bestIndex = 0;
+                int bestError = INT_MAX;
+                for (uint32 p = 0; p < 4; p++)
+                {
+                    const int dr = (int)texels[i * 4 + 0] - palette[p][0];
+                    const int dg = (int)texels[i * 4 + 1] - palette[p][1];
+                    const int db = (int)texels[i * 4 + 2] - palette[p][2];
+                    const int error = dr * dr + dg * dg + db * db;
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        bestIndex = p;
+                    }
+                }
+                indices |= bestIndex << (2 * i);
+            }
+        }
+        StoreUint16(color0, block);
+        StoreUint16(color1, block + 2);
+        memcpy(block + 4, &indices, sizeof(indices));
+    }
+
+    // Encodes one channel, the texels are 4 bytes apart
+    static void EncodeBC4Channel(const uint8* texels, uint8* block)
+    {
+        uint8 minValue = 255;
+        uint8 maxValue = 0;
+        for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+        {
+            minValue = std::min(minValue, texels[i * 4]);
+            maxValue = std::max(maxValue, texels[i * 4]);
+        }
+        // 6 interpolated values
+        uint8 palette[8];
+        CalculateBC4Palette(maxValue, minValue, palette);
+        uint64 indices = 0;
+        if (maxValue != minValue)
+        {
+            for (uint32 i = 0; i < TEXTURE_COMPRESSION_BLOCK_TEXELS; i++)
+            {
+                uint64 bestIndex = 0;
+                int bestError = INT_MAX;
+                for (uint32 p = 0; p < 8; p++)
+                {
+                    const int error = std::abs((int)texels[i * 4] - palette[p]);
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        bestIndex = p;
+                    }
+                }
+                indices |= bestIndex << (3 * i);
+            }
+        }
+        block[0] = maxValue;
+        block[1] = minValue;
+        memcpy(block + 2, &indices, 6);
+    }
+
+    void EncodeBC1Block(const uint8* texels, uint8* block)
+    {
+        EncodeBC1ColorBlock(texels, block);
+    }
+
+    void EncodeBC3Block(const uint8* texels, uint8* block)
+    {
+        EncodeBC4Channel(texels + 3, block);
+        EncodeBC1ColorBlock(texels, block + 8);
+    }
+
+    void EncodeBC4Block(const uint8* texels, uint8* block)
+    {
+        EncodeBC4Channel(texels, block);
+    }
+
+    void EncodeBC5Block(const uint8* texels, uint8* block)
+    {
+        EncodeBC4Channel(texels, block);
+        EncodeBC4Channel(texels + 1, block + 8);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "SRCommon.h"
+
+namespace SR
+{
+    enum
+    {
+        // Texels per side of a block of the BCn formats
+        TEXTURE_COMPRESSION_BLOCK_SIZE = 4,
+        TEXTURE_COMPRESSION_BLOCK_TEXELS = TEXTURE_COMPRESSION_BLOCK_SIZE * TEXTURE_COMPRESSION_BLOCK_SIZE,
+    };
+
+    // Decoders write the 16 texels of a block in row-major order as RGBA8, missing channels read as (0, 0, 0, 255).
+    // BC1 blocks are 8 bytes, BC3 16, BC4 8, BC5 16 and BC7 16.
+    extern void DecodeBC1Block(const uint8* block, uint8* texels);
+    extern void DecodeBC3Block(const uint8* block, uint8* texels);
+    extern void DecodeBC4Block(const uint8* block, uint8* texels);
+    extern void DecodeBC5Block(const uint8* block, uint8* texels);
+    extern void DecodeBC7Block(const uint8* block, uint8* texels);
+
+    // Encoders read the 16 texels of a block in row-major order as RGBA8. BC1 and the color of BC3 are fitted
+    // along the principal axis of the block colors, BC4 and BC5 between the channel extremes. There is no BC7
+    // encoder, BC7 data comes precompressed from offline tools.
+    extern void EncodeBC1Block(const uint8* texels, uint8* block);
+    extern void EncodeBC3Block(const uint8* texels, uint8* block);
+    extern void EncodeBC4Block(const uint8* texels, uint8* block);
+    extern void EncodeBC5Block(const uint8* texels, uint8* block);
+}
\ No newline at end of file